@@ -0,0 +1,65 @@
+/**
+ * Accuracy and cost of the Barnes-Hut cohesion/alignment aggregate against
+ * the exact neighbors returned by intersecting(), for a range of opening
+ * angles. theta = 0 must match the exact result.
+ */
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "index.hpp"
+#include "quadtree.hpp"
+#include "workload.hpp"
+
+#define BOIDS 20000
+#define WORLD 2000
+#define RADIUS 200
+
+int main() {
+    Rng rng(7);
+    std::vector<Boid> boids;
+    for (auto const& p : generate(Workload::Clusters, BOIDS, WORLD, WORLD, 42)) {
+        const auto id = static_cast<std::uint32_t>(boids.size());
+        boids.push_back({p, {rng.uniform(-100.f, 100.f), rng.uniform(-100.f, 100.f)}, id});
+    }
+    boid_rtree tree(boids.begin(), boids.end());
+
+    using clock = std::chrono::steady_clock;
+    std::vector<Aggregate> exact;
+    exact.reserve(boids.size());
+    auto start = clock::now();
+    for (auto const& boid : boids) {
+        Aggregate sum;
+        for (Boid const& other : intersecting(boid.position, tree, RADIUS)) sum.add(other);
+        exact.push_back(sum);
+    }
+    const double exactMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    std::printf("%d boids, radius %d, exact intersecting(): %.1f ms\n\n", BOIDS, RADIUS, exactMs);
+    std::printf("%6s %10s %10s %12s %12s %12s %9s\n", "theta", "time ms", "speedup", "visits/query",
+                "count err %", "center err", "vel err");
+
+    Quadtree quadtree;
+    quadtree.build(boids);
+    for (float theta : {0.f, 0.25f, 0.5f, 0.75f, 1.f, 1.5f, 2.f}) {
+        std::size_t visited = 0;
+        std::vector<Aggregate> approx;
+        approx.reserve(boids.size());
+        start = clock::now();
+        for (auto const& boid : boids)
+            approx.push_back(quadtree.approximate(boid.position, RADIUS, theta, &visited));
+        const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+        double countError = 0, centerError = 0, velocityError = 0;
+        for (std::size_t i = 0; i < boids.size(); ++i) {
+            auto const& e = exact[i];
+            auto const& a = approx[i];
+            countError += std::abs(double(a.count) - double(e.count)) / e.count;
+            if (a.count == 0) continue;
+            centerError += (a.centerOfMass() - e.centerOfMass()).length();
+            velocityError += (a.meanVelocity() - e.meanVelocity()).length();
+        }
+        const double n = static_cast<double>(boids.size());
+        std::printf("%6.2f %10.1f %9.1fx %12.0f %12.3f %10.3fpx %7.3fpx/s\n", theta, ms, exactMs / ms,
+                    visited / n, 100 * countError / n, centerError / n, velocityError / n);
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * Checks the guarantee of the deterministic mode: in every simulation mode
+ * the state hash after a run must not depend on the number of threads, and
+ * the incremental neighbor lists must give the same hash as full queries.
+ * Prints one line per mode and exits with a failure status on the first
+ * mismatch, so that it can guard changes to the kernels. The boid count
+ * and the number of steps can be given as the first two arguments.
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "flock.hpp"
+#include "workload.hpp"
+
+#define BOIDS 5000
+#define STEPS 100
+
+int main(int argc, char* argv[]) {
+    const std::size_t boids = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : BOIDS;
+    const int steps = argc > 2 ? std::max(1, std::atoi(argv[2])) : STEPS;
+    const auto positions = generate(Workload::Clusters, boids, 1000.f, 1000.f, 42);
+
+    struct Mode {
+        char const* name;
+        Flock::Params params;
+    };
+    const Flock::Params base{.deterministic = true};
+    std::vector<Mode> modes = {{"rtree", base}};
+    auto add = [&](char const* name, auto&& change) {
+        Flock::Params params = base;
+        change(params);
+        modes.push_back({name, params});
+    };
+    add("incremental", [](Flock::Params& p) { p.incremental = true; });
+    add("grid AoS", [](Flock::Params& p) { p.index = Flock::Index::Grid; });
+    add("grid SoA", [](Flock::Params& p) {
+        p.index = Flock::Index::Grid;
+        p.layout = Flock::Layout::SoA;
+    });
+    add("grid AoSoA", [](Flock::Params& p) {
+        p.index = Flock::Index::Grid;
+        p.layout = Flock::Layout::AoSoA;
+    });
+    add("quantized", [](Flock::Params& p) { p.quantized = true; });
+    add("species", [](Flock::Params& p) { p.species = true; });
+    add("barnes-hut", [](Flock::Params& p) { p.cohesionRadius = 200.f; });
+    add("lod", [](Flock::Params& p) { p.lodInterval = 4; });
+    add("sleeping", [](Flock::Params& p) {
+        p.sleeping = true;
+        p.drag = 3.f;
+        p.minSpeed = 0.f;
+    });
+
+    auto run = [&](Flock::Params params, unsigned threads) {
+        params.threads = threads;
+        Flock flock(params);
+        flock.spawn(positions);
+        flock.setFocus({{250.f, 250.f}, {750.f, 750.f}});  // Only matters with level of detail
+        for (int i = 0; i < steps; ++i) flock.step(1.f / 60.f);
+        return flock.hash();
+    };
+
+    const unsigned threadCounts[] = {1, 3, std::max(8u, std::thread::hardware_concurrency())};
+    std::printf("%zu boids, %d steps\n\n", boids, steps);
+    std::uint64_t full = 0;
+    for (auto const& mode : modes) {
+        const std::uint64_t reference = run(mode.params, threadCounts[0]);
+        std::printf("%-12s %016" PRIx64, mode.name, reference);
+        for (unsigned threads : threadCounts) {
+            if (threads == threadCounts[0]) continue;
+            if (run(mode.params, threads) != reference) {
+                std::printf("\n%s: the hash differs with %u threads\n", mode.name, threads);
+                return EXIT_FAILURE;
+            }
+        }
+        if (mode.params.incremental && reference != full) {
+            std::printf("\n%s: the hash differs from full queries\n", mode.name);
+            return EXIT_FAILURE;
+        }
+        if (&mode == &modes.front()) full = reference;
+        std::printf("  same with %u, %u threads\n", threadCounts[1], threadCounts[2]);
+    }
+}
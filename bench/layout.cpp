@@ -0,0 +1,58 @@
+/**
+ * Time of the grid force kernel depending on the layout of the cell-sorted
+ * float copy it reads: array of structures (one 16-byte record per boid),
+ * read one candidate at a time, against structure of arrays and blocks of
+ * 8 boids (AoSoA), both read 8 candidates at a time. Only the force stage
+ * is timed, the copy being rebuilt inside it. The boid count can be given
+ * as the first argument; the world grows with it to keep the density
+ * constant.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "flock.hpp"
+#include "workload.hpp"
+
+#define BOIDS 200000
+#define STEPS 50
+
+int main(int argc, char* argv[]) {
+    const std::size_t boids = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : BOIDS;
+    const float side = std::sqrt(static_cast<float>(boids) / 0.01f);  // 1 boid per 100 px^2
+    const auto positions = generate(Workload::Clusters, boids, side, side, 42);
+
+    struct Variant {
+        char const* name;
+        Flock::Layout layout;
+    };
+    const Variant variants[] = {
+        {"AoS", Flock::Layout::AoS}, {"SoA", Flock::Layout::SoA}, {"AoSoA", Flock::Layout::AoSoA}};
+
+    std::printf("%zu boids in a %.0f x %.0f world\n\n", boids, side, side);
+    std::printf("%-8s %8s %12s %12s\n", "layout", "threads", "forces ms", "bytes/boid");
+    std::vector<unsigned> threadCounts = {1};
+    if (std::thread::hardware_concurrency() > 1) threadCounts.push_back(std::thread::hardware_concurrency());
+    for (unsigned threads : threadCounts) {
+        for (auto const& variant : variants) {
+            Flock flock({.width = side,
+                         .height = side,
+                         .threads = threads,
+                         .index = Flock::Index::Grid,
+                         .layout = variant.layout});
+            flock.spawn(positions);
+            flock.step(1.f / 60.f);  // Warm up the buffers
+            double ms = 0.0;
+            for (int i = 0; i < STEPS; ++i) {
+                flock.prepare(1.f / 60.f);
+                const auto start = std::chrono::steady_clock::now();
+                flock.computeForces();
+                ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                flock.integrate();
+            }
+            std::printf("%-8s %8u %12.2f %12.1f\n", variant.name, threads, ms / STEPS,
+                        static_cast<double>(flock.storeBytes()) / static_cast<double>(boids));
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * Cost and accuracy of the 16-bit quantized store against the float stores,
+ * one record per boid and one array per coordinate, all read by the same
+ * grid force kernel. The boid count can be given as the first argument and
+ * the number of timed steps as the second; the world grows with the boids
+ * to keep the density constant.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "flock.hpp"
+#include "workload.hpp"
+
+#define BOIDS 200000
+#define STEPS 100
+
+int main(int argc, char* argv[]) {
+    const std::size_t boids = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : BOIDS;
+    const int steps = argc > 2 ? std::max(1, std::atoi(argv[2])) : STEPS;
+    const float side = std::sqrt(static_cast<float>(boids) / 0.01f);  // 1 boid per 100 px^2
+    const auto positions = generate(Workload::Clusters, boids, side, side, 42);
+
+    auto run = [&](bool quantized, Flock::Layout layout, int steps, bool report) {
+        Flock flock({.width = side,
+                     .height = side,
+                     .index = Flock::Index::Grid,
+                     .quantized = quantized,
+                     .layout = layout});
+        flock.spawn(positions);
+        flock.step(1.f / 60.f);  // Warm up the buffers
+        flock.spawn(positions);
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; ++i) flock.step(1.f / 60.f);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (report)
+            std::printf("%-10s %8.2f ms/step %4zu bytes/boid\n",
+                        quantized ? "quantized" : layout == Flock::Layout::SoA ? "float SoA" : "float AoS", ms / steps,
+                        flock.storeBytes() / boids);
+        return flock.boids();
+    };
+
+    std::printf("%zu boids in a %.0f x %.0f world, %u threads\n\n", boids, side, side,
+                std::thread::hardware_concurrency());
+    run(false, Flock::Layout::AoS, steps, true);
+    run(false, Flock::Layout::SoA, steps, true);
+    run(true, Flock::Layout::AoS, steps, true);
+
+    // Accuracy: divergence of the two runs after a few steps, the flock being chaotic it grows
+    std::printf("\n%6s %14s %14s %14s\n", "steps", "mean pos err", "max pos err", "mean vel err");
+    for (int after : {1, 10, steps}) {
+        auto const reference = run(false, Flock::Layout::SoA, after, false);
+        auto const approximate = run(true, Flock::Layout::AoS, after, false);
+        double position = 0, worst = 0, velocity = 0;
+        for (std::size_t i = 0; i < reference.size(); ++i) {
+            Vec2 offset = reference[i].position - approximate[i].position;
+            offset.x -= side * std::round(offset.x / side);  // The world wraps around
+            offset.y -= side * std::round(offset.y / side);
+            const double d = offset.length();
+            position += d;
+            worst = std::max(worst, d);
+            velocity += (reference[i].velocity - approximate[i].velocity).length();
+        }
+        std::printf("%6d %12.5fpx %12.5fpx %10.5fpx/s\n", after, position / boids, worst, velocity / boids);
+    }
+}
@@ -7,118 +7,767 @@
  * Goal is to have a 60 FPS simulation with 10000 boids.
  */
 #include <SFML/Graphics.hpp>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <sstream>
-#include <boost/geometry.hpp>
-#include <boost/geometry/geometries/point_xy.hpp>
-#include <boost/geometry/index/rtree.hpp>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 
-namespace bg = boost::geometry;
-namespace bgi = boost::geometry::index;
-
-using point_2d = bg::model::d2::point_xy<float>;
-using box = bg::model::box<point_2d>;
+#include "flock.hpp"
+#include "grid.hpp"
+#include "histogram.hpp"
+#include "hud.hpp"
+#include "overlay.hpp"
+#include "pipeline.hpp"
+#include "raster.hpp"
+#include "recorder.hpp"
+#include "render.hpp"
+#include "snapshot.hpp"
+#include "trails.hpp"
+#include "workload.hpp"
 
 #define WINDOW_WIDTH 1000
 #define WINDOW_HEIGHT 1000
+#define WORLD_WIDTH 1000
+#define WORLD_HEIGHT 1000
 
-#define BOIDS 10000
-#define RADIUS 50 // Radius of the circle around the mouse to query for neighbors
+#define BOIDS 10000 // Defaults of --boids, --radius and --seed
+#define RADIUS 50 // Perception radius, also the radius of the circle around the mouse to query for neighbors
+#define SEED 42
+#define MAX_GRID_CELLS 1000000 // Cells of a radius-sized grid above which --radius is rejected
+#define COHESION_RADIUS 200 // Long-range cohesion and alignment through the Barnes-Hut quadtree
+#define LOD_INTERVAL 4 // Off-screen boids are updated every LOD_INTERVAL steps
+#define REST_DRAG 3.f // Velocity fraction lost per second in rest mode, so that boids can settle and sleep
+#define HEATMAP_ZOOM 2.f // World px per screen px above which boids are sub-pixel and drawn as a density map
+#define HEATMAP_SIZE 512 // Cells of the density map along the world width
+#define RECORD_PREFIX "frame_" // Recorded frames are RECORD_PREFIX000000.ppm, ...
+#define RECORD_QUEUE 8 // Frames waiting for the writer thread before new ones are dropped
 
-struct Boid {
-    point_2d position;
-    struct ByPos {
-        using result_type = point_2d;
-        result_type const& operator()(Boid const& boid) const { return boid.position; }
-    };
-    auto toVec2() const { return sf::Vector2f(position.x(), position.y()); }
+#define GRAPH_SAMPLES 240 // Frames shown by the performance graphs
+#define TRAIL_LENGTH 16 // Positions kept per boid for the motion trails
+
+static char const* const layoutNames[] = {"AoS", "SoA", "AoSoA"};
+
+static sf::Vector2f toVec2(point_2d const& position) { return {position.x, position.y}; }
+
+// Parses the whole of `text` into `value`: strtoull and strtof alone stop at the first invalid character
+template <class T>
+static bool parseArgument(char const* text, T& value) {
+    char* end = nullptr;
+    errno = 0;
+    if constexpr (std::is_floating_point_v<T>) {
+        value = std::strtof(text, &end);
+        if (!std::isfinite(value)) return false;
+    } else {
+        // strtoull takes leading spaces and negates a minus sign
+        if (!std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+        const unsigned long long parsed = std::strtoull(text, &end, 10);
+        if (parsed > std::numeric_limits<T>::max()) return false;
+        value = static_cast<T>(parsed);
+    }
+    return end != text && *end == '\0' && errno == 0;
+}
+
+// Names are checked by the caller, which knows the accepted ones
+static bool parseArgument(char const* text, std::string_view& value) {
+    value = text;
+    return true;
+}
+
+// Per-phase cost of one simulation step, for the performance graphs
+struct StepTimes {
+    float index = 0.f;  // ms
+    float query = 0.f;
+    float force = 0.f;
+    float prep = 0.f;
+    float neighbors = 0.f;  // Mean per updated boid
+};
+
+// What the render thread needs from one simulation step
+struct Snapshot {
+    std::vector<Boid> boids;  // Only the visible ones
+    std::size_t total = 0;
+    bool species = false;
+    sf::View view;
+    std::vector<std::uint8_t> heatmap;  // RGBA density, empty when the boids are drawn one by one
+    sf::Vector2u heatmapSize;
+    std::optional<point_2d> mouse;  // None in headless mode
+    std::vector<point_2d> seen;     // Boids within the perception radius of the mouse
+    std::string status;          // Simulation part of the HUD
+    StepTimes times;
+    std::vector<sf::Vertex> overlay;  // Index structure, empty unless shown
+    sf::PrimitiveType overlayType = sf::Lines;
 };
 
-auto intersecting(auto const& search, auto const& tree, float radius) {
-    std::vector<std::reference_wrapper<Boid const>> result;
-    tree.query(bgi::satisfies([&](auto const& boid) {
-                   return bg::distance(boid.position, search) < radius ;
-               }),
-               std::back_inserter(result));
-    return result;
+// Log-scaled cell counts of the grid as RGBA pixels, one per cell
+static void fillHeatmap(Grid const& grid, std::vector<std::uint8_t>& pixels) {
+    pixels.resize(grid.cells() * 4);
+    for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+        const auto v = static_cast<std::uint8_t>(std::min(255.f, 48.f * std::log2(1.f + grid.count(c))));
+        std::uint8_t* pixel = &pixels[c * 4];
+        pixel[0] = v / 4;
+        pixel[1] = v;
+        pixel[2] = v;
+        pixel[3] = 255;
+    }
 }
 
-int main() {
-    sf::ContextSettings settings;
-    settings.antialiasingLevel = 4.0;
-    sf::RenderWindow window(sf::VideoMode(1000, 1000), "Boids", sf::Style::Close, settings);
+static bool writePng(Recorder::Frame const& frame, std::string const& path) {
+    sf::Image image;
+    image.create(frame.width, frame.height, frame.pixels.data());
+    return image.saveToFile(path);
+}
+
+// Numbers the frames from `first`, so that a recording does not overwrite the files of the previous ones
+static void startRecording(std::optional<Recorder>& recorder, bool png, std::uint64_t first = 0) {
+    if (png)
+        recorder.emplace(RECORD_PREFIX, RECORD_QUEUE, "png", writePng, first);
+    else
+        recorder.emplace(RECORD_PREFIX, RECORD_QUEUE, "ppm", Recorder::writePpm, first);
+}
 
-    bgi::rtree<Boid, bgi::quadratic<32>, Boid::ByPos> rtree;
+// Frame time percentiles of the histogram, in ms
+static std::string percentiles(Histogram const& frameTimes) {
+    char line[96];
+    std::snprintf(line, sizeof(line), "p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f ms",
+                  1000.0 * frameTimes.percentile(50.0), 1000.0 * frameTimes.percentile(90.0),
+                  1000.0 * frameTimes.percentile(99.0), 1000.0 * frameTimes.percentile(99.9),
+                  1000.0 * frameTimes.max());
+    return line;
+}
+
+// World rectangle shown by a view
+static box visible(sf::View const& view) {
+    const sf::Vector2f corner = view.getCenter() - view.getSize() / 2.f;
+    return {{corner.x, corner.y}, {corner.x + view.getSize().x, corner.y + view.getSize().y}};
+}
 
-    for (int i = 0; i < BOIDS; ++i) {
-        const auto x = static_cast<float>(rand() % WINDOW_WIDTH);
-        const auto y = static_cast<float>(rand() % WINDOW_HEIGHT);
-        rtree.insert({{x, y}});
+// Zooms the view by `factor`, keeping the world point under `pixel` in place
+static void zoomAt(sf::View& view, sf::RenderWindow const& window, sf::Vector2i pixel, float factor) {
+    const sf::Vector2f before = window.mapPixelToCoords(pixel, view);
+    view.zoom(factor);
+    view.move(before - window.mapPixelToCoords(pixel, view));
+}
+
+// A few walls and polygons for the boids to flow around
+static std::vector<segment> obstacleScene(float width, float height) {
+    std::vector<segment> walls;
+    const point_2d square[] = {{0.15f * width, 0.15f * height}, {0.3f * width, 0.15f * height},
+                               {0.3f * width, 0.3f * height}, {0.15f * width, 0.3f * height}};
+    const point_2d triangle[] = {{0.7f * width, 0.65f * height}, {0.85f * width, 0.85f * height},
+                                 {0.6f * width, 0.85f * height}};
+    Obstacles::outline(square, walls);
+    Obstacles::outline(triangle, walls);
+    walls.emplace_back(point_2d{0.65f * width, 0.2f * height}, point_2d{0.85f * width, 0.4f * height});
+    walls.emplace_back(point_2d{0.2f * width, 0.7f * height}, point_2d{0.2f * width, 0.9f * height});
+    return walls;
+}
+
+/**
+ * Draws snapshots into a render target, the window or an off-screen
+ * texture, so that both show exactly the same thing.
+ */
+class Painter {
+public:
+    // `radius` is that of the circle drawn around the mouse, the perception radius
+    Painter(sf::Font const& font, Obstacles const& obstacles, float heatmapCell, float radius, sf::Vector2u size)
+        : raster_(size.x, size.y),
+          trails_(TRAIL_LENGTH, WORLD_WIDTH / 2.f),
+          walls_(sf::Lines),
+          seen_(sf::Quads),
+          cell_(heatmapCell) {
+        for (auto const& wall : obstacles.segments()) {
+            walls_.append({toVec2(wall.first), sf::Color::Red});
+            walls_.append({toVec2(wall.second), sf::Color::Red});
+        }
+        text_.setFont(font);
+        text_.setCharacterSize(24);
+        text_.setFillColor(sf::Color::White);
+        text_.setPosition(10.f, 10.f);
+        spotlight_.setFillColor(sf::Color(255, 255, 255, 35));
+        spotlight_.setRadius(radius);
+        spotlight_.setOrigin(radius, radius);  // Centered on the mouse
+        heatmap_.setSmooth(true);
+        rasterTexture_.create(size.x, size.y);
     }
 
-    // Load a font
-    sf::Font font;
-    if (!font.loadFromFile("collegiate.ttf")) std::cout << "Error loading font" << std::endl;
-
-    // Setup text
-    sf::Text text("", font);
-    text.setCharacterSize(24);
-    text.setFillColor(sf::Color::White);
-    text.setPosition(10.f, 10.f);
-
-    // Mouse circle
-    sf::CircleShape spotlight(1.f);
-    spotlight.setFillColor(sf::Color(255, 255, 255, 35));
-    spotlight.setRadius(RADIUS);
-
-    // Boid circle
-    sf::CircleShape boidShape(1.f);
-    boidShape.setFillColor(sf::Color::Cyan);
-
-    // Highlight circle
-    sf::CircleShape boidSeen(2.f);
-    boidSeen.setFillColor(sf::Color::Yellow);
-
-    sf::Clock frameClock;
-    sf::Clock updateClock;
-    float fps = 0.0f;
-    while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) { if (event.type == sf::Event::Closed) window.close(); }
+    BoidRenderer& renderer() { return renderer_; }
+
+    // Boids splatted on the CPU by the software rasterizer instead of drawn by GL
+    bool software = false;
+    // Motion trails behind the boids
+    bool trails = false;
 
-        window.clear();
+    // ms spent by the last paint() building glyphs, trails and textures, before any draw call
+    float prepareTime() const { return prepareTime_; }
 
-        sf::Vector2i mousePosition = sf::Mouse::getPosition(window);
-        sf::Vector2f mousePositionFloat = sf::Vector2f(mousePosition.x, mousePosition.y);
+    // Draws the snapshot, `fresh` if it changed since the last call, and returns the number of draw calls
+    unsigned paint(sf::RenderTarget& target, Snapshot const& snapshot, bool fresh, std::string const& hud) {
+        sf::Clock prepareClock;
+        const bool splat = software && snapshot.heatmap.empty();
+        if ((fresh || software != splatted_) && splat) {
+            raster_.render(snapshot.boids, visible(snapshot.view), snapshot.species, pool_);
+            rasterTexture_.update(raster_.pixels());
+        }
+        splatted_ = software;
+        // The glyphs are not rebuilt while the raster or the heatmap replaces them, so they are out of date after
+        const bool glyphs = !splat && snapshot.heatmap.empty();
+        if (glyphs && !glyphs_) renderer_.invalidate();
+        glyphs_ = glyphs;
+        if ((fresh || renderer_.stale()) && glyphs) renderer_.prepare(snapshot.boids, snapshot.species);
+        const bool trailed = trails && snapshot.heatmap.empty();
+        if (fresh && trailed) {
+            trails_.record(snapshot.boids, snapshot.total);
+            trails_.prepare(snapshot.boids, snapshot.species, pool_);
+        }
+        if (fresh && !snapshot.heatmap.empty()) {
+            if (heatmap_.getSize().x != snapshot.heatmapSize.x || heatmap_.getSize().y != snapshot.heatmapSize.y)
+                heatmap_.create(snapshot.heatmapSize.x, snapshot.heatmapSize.y);
+            heatmap_.update(snapshot.heatmap.data());
+        }
+        prepareTime_ = prepareClock.getElapsedTime().asSeconds() * 1000.f;
+
+        unsigned calls = 0;
+        target.clear();
+        if (splat) {
+            target.setView(target.getDefaultView());
+            target.draw(sf::Sprite(rasterTexture_));
+            ++calls;
+        }
+        target.setView(snapshot.view);
 
         // Draw clear alpha circle around mouse
-        spotlight.setPosition(mousePositionFloat - sf::Vector2f(RADIUS, RADIUS));
-        window.draw(spotlight);
+        if (snapshot.mouse) {
+            spotlight_.setPosition(toVec2(*snapshot.mouse));
+            target.draw(spotlight_);
+            ++calls;
+        }
+        target.draw(walls_);
+        ++calls;
+        if (trailed) {
+            trails_.draw(target);
+            ++calls;
+        }
+        if (glyphs) {
+            calls += renderer_.draw(target);
+        } else if (!snapshot.heatmap.empty()) {
+            sf::Sprite sprite(heatmap_);
+            sprite.setScale(cell_, cell_);
+            target.draw(sprite);
+            ++calls;
+        }
+
+        seen_.clear();
+        for (point_2d const& position : snapshot.seen) {
+            const sf::Vector2f p = toVec2(position);
+            for (sf::Vector2f corner : {sf::Vector2f(0.f, 0.f), {4.f, 0.f}, {4.f, 4.f}, {0.f, 4.f}})
+                seen_.append({p + corner, sf::Color::Yellow});
+        }
+        target.draw(seen_);
+        ++calls;
+        if (!snapshot.overlay.empty()) {
+            target.draw(snapshot.overlay.data(), snapshot.overlay.size(), snapshot.overlayType);
+            ++calls;
+        }
+
+        target.setView(target.getDefaultView());
+        text_.setString(hud);
+        target.draw(text_);
+        return calls + 1;
+    }
+
+private:
+    BoidRenderer renderer_;
+    Rasterizer raster_;
+    Trails trails_;
+    ThreadPool pool_;  // Separate from the simulation's, which is busy on another thread
+    sf::Texture rasterTexture_;
+    bool splatted_ = false;
+    bool glyphs_ = false;  // The renderer drew the boids last frame
+    sf::Texture heatmap_;
+    sf::VertexArray walls_;
+    sf::VertexArray seen_;  // Boids near the mouse, batched like the flock
+    sf::CircleShape spotlight_;
+    sf::Text text_;
+    float cell_;
+    float prepareTime_ = 0.f;
+};
 
-        for (auto const& boid : rtree) {
-            boidShape.setPosition(boid.toVec2());
-            window.draw(boidShape);
+int main(int argc, char* argv[]) {
+    // --headless runs without any window, --offscreen draws into a texture and --raster into a CPU image
+    // without GL; all of them stop after --frames steps and print the time of each stage. --record writes
+    // every drawn frame, --png as PNG. The simulation is set up by --boids, --radius, --index (rtree, grid
+    // or quantized), --threads and --seed, in every mode; --deterministic prints the state hash of every step
+    enum class Output { Window, None, Texture, Image };
+    Output output = Output::Window;
+    std::uint64_t frames = 600;
+    bool record = false;
+    bool png = false;
+    bool deterministic = false;
+    std::size_t boids = BOIDS;
+    float radius = RADIUS;
+    std::string_view index = "rtree";
+    unsigned threads = std::thread::hardware_concurrency();
+    std::uint64_t seed = SEED;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool valued = i + 1 < argc;
+        bool parsed = true;
+        if (arg == "--headless")
+            output = Output::None;
+        else if (arg == "--offscreen")
+            output = Output::Texture;
+        else if (arg == "--raster")
+            output = Output::Image;
+        else if (arg == "--record")
+            record = true;
+        else if (arg == "--png")
+            png = true;
+        else if (arg == "--deterministic")
+            deterministic = true;
+        else if (arg == "--frames")
+            parsed = valued && parseArgument(argv[++i], frames);
+        else if (arg == "--boids")
+            parsed = valued && parseArgument(argv[++i], boids);
+        else if (arg == "--radius")
+            parsed = valued && parseArgument(argv[++i], radius);
+        else if (arg == "--index")
+            parsed = valued && parseArgument(argv[++i], index);
+        else if (arg == "--threads")
+            parsed = valued && parseArgument(argv[++i], threads);
+        else if (arg == "--seed")
+            parsed = valued && parseArgument(argv[++i], seed);
+        else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!parsed) {
+            if (valued)
+                std::cerr << "Invalid value " << argv[i] << " for " << arg << std::endl;
+            else
+                std::cerr << "Missing value for " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (index != "rtree" && index != "grid" && index != "quantized") {
+        std::cerr << "Unknown index " << index << ", expected rtree, grid or quantized" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!(radius > 0.f)) {
+        std::cerr << "The radius must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // The flock keeps grids with cells of the radius whatever the index
+    if (Grid::cellCount(WORLD_WIDTH, WORLD_HEIGHT, radius) > MAX_GRID_CELLS) {
+        std::cerr << "The radius " << radius << " gives more than " << MAX_GRID_CELLS << " grid cells" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const sf::View world(sf::FloatRect(0.f, 0.f, WORLD_WIDTH, WORLD_HEIGHT));
+    sf::View camera = world;  // Owned by the main thread, handed to the render thread with each snapshot
+    std::optional<point_2d> mouse;
+
+    Flock flock({.width = WORLD_WIDTH,
+                 .height = WORLD_HEIGHT,
+                 .radius = radius,
+                 .threads = std::max(1u, threads),
+                 .deterministic = deterministic,
+                 .index = index == "rtree" ? Flock::Index::RTree : Flock::Index::Grid,
+                 .quantized = index == "quantized"});
+    flock.setObstacles(Obstacles(obstacleScene(WORLD_WIDTH, WORLD_HEIGHT)));
+
+    std::size_t workload = 0;
+    flock.spawn(generate(workloads[workload], boids, WORLD_WIDTH, WORLD_HEIGHT, seed, radius));
+
+    // Density map used when zoomed out, built from the cell counts of a fine grid
+    Grid density(WORLD_WIDTH, WORLD_HEIGHT, static_cast<float>(WORLD_WIDTH) / HEATMAP_SIZE);
+
+    FramePipeline pipeline;
+    TripleBuffer<Snapshot> snapshots;
+    float stepRate = 0.f;
+    bool showIndex = false;  // Overlay of the index structure, toggled with O
+    std::vector<NodeLevel> levels;
+
+    // Culling reads the structures of the previous step, which the index and force stages leave alone
+    std::vector<Boid> nearMouse;
+    auto prepare = [&] {
+        Snapshot& snapshot = snapshots.back();
+        snapshot.total = flock.boids().size();
+        snapshot.species = flock.params().species;
+        snapshot.view = camera;
+        snapshot.heatmap.clear();
+        snapshot.boids.clear();
+        if (camera.getSize().x / WINDOW_WIDTH > HEATMAP_ZOOM) {
+            density.build(flock.boids());
+            fillHeatmap(density, snapshot.heatmap);
+            snapshot.heatmapSize = {static_cast<unsigned>(density.columns()), static_cast<unsigned>(density.rows())};
+        } else {
+            box shown = visible(snapshot.view);
+            // Keep the boids whose glyph pokes into the view
+            shown.min_corner() -= Vec2{BoidRenderer::reach(), BoidRenderer::reach()};
+            shown.max_corner() += Vec2{BoidRenderer::reach(), BoidRenderer::reach()};
+            flock.cull(shown, snapshot.boids);
         }
 
-        for (Boid const & boid : intersecting(point_2d(mousePosition.x, mousePosition.y), rtree, RADIUS)) {
-            boidSeen.setPosition(boid.toVec2());
-            window.draw(boidSeen);
+        snapshot.mouse = mouse;
+        snapshot.seen.clear();
+        if (mouse) {
+            nearMouse.clear();
+            flock.cull(around(*mouse, radius), nearMouse);
+            for (Boid const& boid : nearMouse)
+                if ((boid.position - *mouse).lengthSquared() < radius * radius) snapshot.seen.push_back(boid.position);
         }
+    };
+
+    auto publish = [&] {
+        Snapshot& snapshot = snapshots.back();
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << stepRate << " steps/s, " << name(workloads[workload]);
+        if (snapshot.heatmap.empty())
+            ss << "\n" << snapshot.boids.size() << " of " << snapshot.total << " boids visible";
+        else
+            ss << "\ndensity map, " << snapshot.total << " boids";
+        if (flock.params().quantized)
+            ss << ", quantized grid";
+        else if (flock.params().index == Flock::Index::Grid)
+            ss << ", grid " << layoutNames[static_cast<int>(flock.params().layout)];
+        if (flock.params().species) ss << "\nspecies: prey, predators, neutral";
+        if (flock.params().cohesionRadius > 0.f) ss << "\nBarnes-Hut cohesion";
+        if (flock.params().lodInterval > 1) ss << "\nLOD, " << flock.stats().updated << " updated";
+        if (flock.params().incremental) ss << "\nincremental, " << flock.stats().queries << " queries";
+        if (flock.params().sleeping) ss << "\nrest mode, " << flock.stats().sleeping << " asleep";
+        ss << "\n" << (pipeline.pipelined ? "pipelined" : "sequential") << " stages (ms):";
+        for (int stage = 0; stage < FramePipeline::StageCount; ++stage) {
+            auto const& span = pipeline.span(static_cast<FramePipeline::Stage>(stage));
+            ss << "\n  " << FramePipeline::names[stage] << " " << span.start << " - " << span.end;
+        }
+        // Drawn from the index of this step, hence here rather than in render prep
+        snapshot.overlay.clear();
+        if (showIndex && (flock.params().index == Flock::Index::Grid || flock.params().quantized) &&
+            !flock.params().species) {
+            const CellOccupancy occupancy = fillCells(flock.grid(), snapshot.overlay);
+            snapshot.overlayType = sf::Quads;
+            ss << "\ngrid cells: fullest " << occupancy.max << ", mean " << occupancy.mean << ", "
+               << occupancy.crowded << " over " << crowdedRatio << "x the mean";
+        } else if (showIndex) {
+            outlineNodes(flock.index(), snapshot.overlay, levels);
+            snapshot.overlayType = sf::Lines;
+            ss << "\nrtree nodes (area / root):";
+            for (std::size_t level = 0; level < levels.size(); ++level)
+                ss << (level ? ", " : " ") << levels[level].nodes << " (" << levels[level].area << "x)";
+        }
+        if (flock.params().deterministic)
+            ss << "\nstep " << flock.steps() << " hash " << std::hex << std::setw(16) << std::setfill('0')
+               << flock.hash();
+        snapshot.status = ss.str();
+
+        // The force stage is split with the query share measured by the flock, when profiling
+        auto length = [&](FramePipeline::Stage stage) { return pipeline.span(stage).end - pipeline.span(stage).start; };
+        const float forces = length(FramePipeline::Forces);
+        const Flock::Stats& stats = flock.stats();
+        snapshot.times = {.index = length(FramePipeline::Index),
+                          .query = forces * stats.queryShare,
+                          .force = forces * (1.f - stats.queryShare),
+                          .prep = length(FramePipeline::RenderPrep),
+                          .neighbors = stats.updated ? static_cast<float>(stats.neighbors) / stats.updated : 0.f};
+        snapshots.publish();
+    };
 
-        // Calculate FPS
-        sf::Time frameTime = frameClock.restart();
-        if (updateClock.getElapsedTime().asSeconds() >= 0.5) {
-            fps = 1.0f / frameTime.asSeconds();
-            updateClock.restart();
+    // Fixed timestep so that runs are reproducible
+    std::array<Histogram, FramePipeline::StageCount> stageTimes;
+    auto step = [&] {
+        pipeline.run(flock, 1.f / 60.f, prepare, publish);
+        for (int stage = 0; stage < FramePipeline::StageCount; ++stage) {
+            auto const& span = pipeline.span(static_cast<FramePipeline::Stage>(stage));
+            stageTimes[stage].record((span.end - span.start) / 1000.0);
         }
+        if (flock.params().deterministic)
+            std::printf("step %llu hash %016llx\n", static_cast<unsigned long long>(flock.steps()),
+                        static_cast<unsigned long long>(flock.hash()));
+    };
+
+    // Load a font
+    sf::Font font;
+    if ((output == Output::Window || output == Output::Texture) && !font.loadFromFile("collegiate.ttf"))
+        std::cout << "Error loading font" << std::endl;
 
-        // Display FPS
-        {
+    // Headless: the same steps as fast as possible, drawn into a texture, an image or not drawn at all
+    if (output != Output::Window) {
+        std::optional<sf::RenderTexture> texture;
+        std::optional<Painter> painter;
+        std::optional<Rasterizer> raster;
+        if (output == Output::Image) raster.emplace(WINDOW_WIDTH, WINDOW_HEIGHT);
+        if (output == Output::Texture) {
+            texture.emplace();
+            if (!texture->create(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+                std::cerr << "Cannot create the off-screen texture" << std::endl;
+                return EXIT_FAILURE;
+            }
+            painter.emplace(font, flock.obstacles(), density.cellSize(), radius, texture->getSize());
+        }
+        std::optional<Recorder> recorder;
+        if (record && output != Output::None) startRecording(recorder, png);
+
+        std::printf("%zu boids, radius %g, %.*s index, %u threads, seed %llu, %s stages\n", flock.boids().size(),
+                    static_cast<double>(flock.params().radius), static_cast<int>(index.size()), index.data(),
+                    flock.params().threads, static_cast<unsigned long long>(seed),
+                    pipeline.pipelined ? "pipelined" : "sequential");
+        Histogram frameTimes;
+        const auto start = std::chrono::steady_clock::now();
+        auto frameStart = start;
+        for (std::uint64_t frame = 0; frame < frames; ++frame) {
+            step();
+            // Rasterizing between steps, the simulation's pool is free
+            if (raster && snapshots.acquire()) {
+                raster->render(snapshots.front().boids, visible(snapshots.front().view), snapshots.front().species,
+                               flock.pool());
+                if (recorder) recorder->push(raster->width(), raster->height(), raster->pixels());
+            }
+            if (texture) {
+                const bool fresh = snapshots.acquire();
+                painter->paint(*texture, snapshots.front(), fresh, snapshots.front().status);
+                texture->display();
+                if (recorder) {
+                    const sf::Image image = texture->getTexture().copyToImage();
+                    recorder->push(image.getSize().x, image.getSize().y, image.getPixelsPtr());
+                }
+            }
+            const auto frameEnd = std::chrono::steady_clock::now();
+            frameTimes.record(std::chrono::duration<double>(frameEnd - frameStart).count());
+            frameStart = frameEnd;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%llu frames of %zu boids in %.2f s, %.2f ms per frame\n",
+                    static_cast<unsigned long long>(frames), flock.boids().size(), seconds,
+                    frames ? 1000.0 * seconds / static_cast<double>(frames) : 0.0);
+        std::printf("frame times: %s\n", percentiles(frameTimes).c_str());
+        std::printf("%-12s %8s %8s %8s %8s (ms)\n", "stage", "mean", "p50", "p99", "max");
+        for (int stage = 0; stage < FramePipeline::StageCount; ++stage) {
+            Histogram const& times = stageTimes[stage];
+            std::printf("%-12.*s %8.3f %8.3f %8.3f %8.3f\n", static_cast<int>(FramePipeline::names[stage].size()),
+                        FramePipeline::names[stage].data(), 1000.0 * times.mean(), 1000.0 * times.percentile(50.0),
+                        1000.0 * times.percentile(99.0), 1000.0 * times.max());
+        }
+        std::printf("%zu index queries and %.1f neighbors per boid in the last step\n", flock.stats().queries,
+                    flock.stats().updated ? static_cast<double>(flock.stats().neighbors) / flock.stats().updated : 0.0);
+        sf::Image image;
+        if (texture) image = texture->getTexture().copyToImage();
+        if (raster) image.create(raster->width(), raster->height(), raster->pixels());
+        if ((texture || raster) && !image.saveToFile("headless.png")) std::cerr << "Cannot save headless.png" << std::endl;
+        if (recorder) {
+            recorder->flush();
+            std::printf("recorded %llu frames, %llu failed, %llu dropped\n",
+                        static_cast<unsigned long long>(recorder->written()),
+                        static_cast<unsigned long long>(recorder->failed()),
+                        static_cast<unsigned long long>(recorder->dropped()));
+        }
+        return EXIT_SUCCESS;
+    }
+
+    sf::ContextSettings settings;
+    settings.antialiasingLevel = 4.0;
+    sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "Boids", sf::Style::Close, settings);
+    std::atomic<bool> running = true;
+    std::atomic<bool> buffered = false;  // Render path requested with V
+    std::atomic<bool> software = false;  // Software rasterizer requested with R
+    std::atomic<bool> triangles = true;  // Oriented triangles or quads, toggled with T
+    std::atomic<bool> trails = false;  // Toggled with M
+    std::atomic<bool> recording = record;  // Toggled with F
+    std::atomic<bool> graphs = false;  // Performance graphs, toggled with H
+    Histogram frameTimes;  // Every frame of the render thread, reported at exit
+
+    // The render thread owns the GL context: vsync and slow frames never block the simulation
+    window.setVerticalSyncEnabled(true);
+    window.setActive(false);
+    std::thread renderThread([&] {
+        window.setActive(true);
+        Painter painter(font, flock.obstacles(), density.cellSize(), radius, window.getSize());
+        unsigned drawCalls = 0;
+        float renderCpu = 0.f;  // ms spent preparing and submitting the frame, before display
+        float renderPrep = 0.f;  // Part of it building the vertices, plus the culling of a fresh snapshot
+        sf::Clock frameClock;
+        sf::Clock updateClock;
+        float fps = 0.0f;
+        std::uint64_t rendered = 0;  // Frames since the last FPS update
+        std::optional<Recorder> recorder;
+        std::uint64_t recordedFrames = 0;  // Over all the recordings so far, the number of the next frame
+        sf::Texture capture;
+        enum Graph { Index, Query, Force, Prep, Draw, Neighbors };
+        PerfGraphs perf({{"index", " ms", sf::Color(255, 200, 0)},
+                         {"query", " ms", sf::Color(255, 120, 0)},
+                         {"force", " ms", sf::Color(255, 60, 60)},
+                         {"render prep", " ms", sf::Color(120, 200, 255)},
+                         {"draw", " ms", sf::Color(120, 255, 120)},
+                         {"neighbors", "", sf::Color(220, 160, 255)}},
+                        font, sf::FloatRect(WINDOW_WIDTH - 340.f, 10.f, 330.f, 6 * 56.f), GRAPH_SAMPLES);
+        while (running) {
+            // Stopping waits for the queued frames to be written, on this thread rather than the simulation's
+            if (recording && !recorder) startRecording(recorder, png, recordedFrames);
+            if (!recording && recorder) {
+                recordedFrames = recorder->next();
+                recorder.reset();
+            }
+
+            sf::Clock cpuClock;
+            BoidRenderer& renderer = painter.renderer();
+            const auto mode = buffered ? BoidRenderer::Mode::Buffered : BoidRenderer::Mode::Immediate;
+            if (renderer.mode() != mode) renderer.setMode(mode);
+            const auto glyph = triangles ? BoidRenderer::Glyph::Triangle : BoidRenderer::Glyph::Quad;
+            if (renderer.glyph() != glyph) renderer.setGlyph(glyph);
+            painter.software = software;
+            painter.trails = trails;
+            const bool fresh = snapshots.acquire();
+
+            // Every frame goes into the histogram, the FPS is averaged over half a second
+            const sf::Time frameTime = frameClock.restart();
+            frameTimes.record(frameTime.asSeconds());
+            ++rendered;
+            if (updateClock.getElapsedTime().asSeconds() >= 0.5) {
+                fps = static_cast<float>(rendered) / updateClock.restart().asSeconds();
+                rendered = 0;
+            }
+
+            // Display FPS
             std::stringstream ss;
-            ss << std::fixed << std::setprecision(2) << fps << " FPS";
-            text.setString(ss.str());
-            window.draw(text);
+            ss << std::fixed << std::setprecision(2) << fps << " FPS, " << snapshots.dropped()
+               << " snapshots dropped";
+            ss << "\nframe " << percentiles(frameTimes);
+            ss << "\nrender "
+               << (painter.software                                 ? "software"
+                   : renderer.mode() == BoidRenderer::Mode::Buffered ? "buffered"
+                                                                     : "immediate")
+               << ": " << drawCalls << " draw calls, " << std::setprecision(2) << renderCpu << " ms CPU, "
+               << renderer.uploaded() << " vertices sent";
+            if (recorder)
+                ss << "\nrecording: " << recorder->written() << " written, " << recorder->dropped() << " dropped";
+            ss << "\n" << snapshots.front().status;
+
+            drawCalls = painter.paint(window, snapshots.front(), fresh, ss.str());
+            renderCpu = cpuClock.getElapsedTime().asSeconds() * 1000.f;
+            renderPrep = painter.prepareTime() + (fresh ? snapshots.front().times.prep : 0.f);
+
+            // Simulation samples come once per snapshot, the render ones once per frame
+            if (fresh) {
+                StepTimes const& times = snapshots.front().times;
+                perf.push(Index, times.index);
+                perf.push(Query, times.query);
+                perf.push(Force, times.force);
+                perf.push(Neighbors, times.neighbors);
+            }
+            perf.push(Prep, renderPrep);
+            perf.push(Draw, renderCpu - painter.prepareTime());
+            if (graphs) {
+                perf.update();
+                window.setView(window.getDefaultView());
+                perf.draw(window);
+            }
+            if (recorder) {
+                if (capture.getSize().x != window.getSize().x || capture.getSize().y != window.getSize().y)
+                    capture.create(window.getSize().x, window.getSize().y);
+                capture.update(window);
+                const sf::Image image = capture.copyToImage();
+                recorder->push(image.getSize().x, image.getSize().y, image.getPixelsPtr());
+            }
+            window.display();
+        }
+        window.setActive(false);
+    });
+
+    // Paced to real time
+    const auto period = std::chrono::microseconds(1000000 / 60);
+    auto next = std::chrono::steady_clock::now();
+    sf::Clock rateClock;
+    std::uint64_t rateSteps = flock.steps();
+    while (running) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed) running = false;
+            if (event.type == sf::Event::MouseWheelScrolled)
+                zoomAt(camera, window, {event.mouseWheelScroll.x, event.mouseWheelScroll.y},
+                       event.mouseWheelScroll.delta > 0.f ? 1.f / 1.25f : 1.25f);
+            if (event.type != sf::Event::KeyPressed) continue;
+            switch (event.key.code) {
+                case sf::Keyboard::D: flock.setDeterministic(!flock.params().deterministic); break;
+                case sf::Keyboard::I: flock.setIncremental(!flock.params().incremental); break;
+                case sf::Keyboard::G:
+                    flock.setIndex(flock.params().index == Flock::Index::Grid ? Flock::Index::RTree
+                                                                              : Flock::Index::Grid);
+                    break;
+                case sf::Keyboard::Q: flock.setQuantized(!flock.params().quantized); break;
+                case sf::Keyboard::A:
+                    flock.setLayout(static_cast<Flock::Layout>((static_cast<int>(flock.params().layout) + 1) % 3));
+                    break;
+                case sf::Keyboard::B:
+                    flock.setCohesionRadius(flock.params().cohesionRadius > 0.f ? 0.f : COHESION_RADIUS);
+                    break;
+                case sf::Keyboard::L:
+                    flock.setLevelOfDetail(flock.params().lodInterval == 1 ? LOD_INTERVAL : 1);
+                    break;
+                case sf::Keyboard::S: flock.setSpecies(!flock.params().species); break;
+                case sf::Keyboard::P: pipeline.pipelined = !pipeline.pipelined; break;
+                case sf::Keyboard::V: buffered = !buffered; break;
+                case sf::Keyboard::R: software = !software; break;
+                case sf::Keyboard::T: triangles = !triangles; break;
+                case sf::Keyboard::M: trails = !trails; break;
+                case sf::Keyboard::O: showIndex = !showIndex; break;
+                case sf::Keyboard::F: recording = !recording; break;
+                case sf::Keyboard::H:
+                    graphs = !graphs;
+                    flock.setProfiling(graphs);
+                    break;
+                case sf::Keyboard::Left: camera.move(-0.1f * camera.getSize().x, 0.f); break;
+                case sf::Keyboard::Right: camera.move(0.1f * camera.getSize().x, 0.f); break;
+                case sf::Keyboard::Up: camera.move(0.f, -0.1f * camera.getSize().y); break;
+                case sf::Keyboard::Down: camera.move(0.f, 0.1f * camera.getSize().y); break;
+                case sf::Keyboard::C: camera = world; break;
+                case sf::Keyboard::Z: {
+                    const bool rest = !flock.params().sleeping;
+                    flock.setSleeping(rest);
+                    flock.setDrag(rest ? REST_DRAG : 0.f);
+                    flock.setMinSpeed(rest ? 0.f : Flock::Params{}.minSpeed);
+                    break;
+                }
+                case sf::Keyboard::W:
+                    workload = (workload + 1) % workloads.size();
+                    flock.spawn(generate(workloads[workload], boids, WORLD_WIDTH, WORLD_HEIGHT, seed, radius));
+                    break;
+                default: break;
+            }
         }
-        window.display();
+
+        // The visible part of the world gets full-rate updates
+        flock.setFocus(visible(camera));
+        const sf::Vector2f pointer = window.mapPixelToCoords(sf::Mouse::getPosition(window), camera);
+        mouse = point_2d(pointer.x, pointer.y);
+
+        if (rateClock.getElapsedTime().asSeconds() >= 0.5f) {
+            stepRate = static_cast<float>(flock.steps() - rateSteps) / rateClock.restart().asSeconds();
+            rateSteps = flock.steps();
+        }
+
+        step();
+
+        // Sleep until the next step is due; after a long stall, resume from now rather than catching up
+        next += period;
+        const auto now = std::chrono::steady_clock::now();
+        if (now > next + 4 * period) next = now;
+        std::this_thread::sleep_until(next);
     }
+
+    renderThread.join();
+    window.close();
+    std::printf("%llu frames, frame times: %s\n", static_cast<unsigned long long>(frameTimes.count()),
+                percentiles(frameTimes).c_str());
 }
@@ -0,0 +1,62 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/register/point.hpp>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+/**
+ * Plain 2D vector used for positions and velocities. It is registered as a
+ * Boost.Geometry point so it can be indexed and measured directly.
+ */
+struct Vec2 {
+    float x = 0.f;
+    float y = 0.f;
+
+    Vec2& operator+=(Vec2 other) {
+        x += other.x;
+        y += other.y;
+        return *this;
+    }
+    Vec2& operator-=(Vec2 other) {
+        x -= other.x;
+        y -= other.y;
+        return *this;
+    }
+    Vec2& operator*=(float k) {
+        x *= k;
+        y *= k;
+        return *this;
+    }
+    friend Vec2 operator+(Vec2 a, Vec2 b) { return a += b; }
+    friend Vec2 operator-(Vec2 a, Vec2 b) { return a -= b; }
+    friend Vec2 operator*(Vec2 a, float k) { return a *= k; }
+    friend Vec2 operator*(float k, Vec2 a) { return a *= k; }
+    friend Vec2 operator/(Vec2 a, float k) { return a *= 1.f / k; }
+    friend bool operator==(Vec2 a, Vec2 b) = default;
+
+    float lengthSquared() const { return x * x + y * y; }
+    float length() const { return std::sqrt(lengthSquared()); }
+};
+
+BOOST_GEOMETRY_REGISTER_POINT_2D(Vec2, float, bg::cs::cartesian, x, y)
+
+using point_2d = Vec2;
+using box = bg::model::box<point_2d>;
+
+enum class Species : std::uint8_t { Prey, Predator, Neutral };
+
+struct Boid {
+    point_2d position;
+    Vec2 velocity;
+    std::uint32_t id = 0;
+    Species species = Species::Prey;
+    friend bool operator==(Boid const&, Boid const&) = default;
+    struct ByPos {
+        using result_type = point_2d;
+        result_type const& operator()(Boid const& boid) const { return boid.position; }
+    };
+};
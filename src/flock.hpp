@@ -0,0 +1,896 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "boid.hpp"
+#include "grid.hpp"
+#include "index.hpp"
+#include "obstacles.hpp"
+#include "parallel.hpp"
+#include "quadtree.hpp"
+#include "store.hpp"
+
+/**
+ * The simulation itself: boids are moved by the classic separation,
+ * alignment and cohesion rules, using the R-tree to find the neighbors
+ * within the perception radius. The index is bulk loaded from the boids at
+ * the start of every step, then forces and integration run in parallel.
+ *
+ * In deterministic mode the neighbors of each boid are visited in boid ID
+ * order and a hash of the whole state is computed after every step, so a
+ * run can be compared bit for bit across machines and thread counts, from
+ * the same initial positions. The build turns off fused multiply-adds and
+ * the step only relies on correctly rounded operations (sqrt included), so
+ * neither the CPU nor its math library changes the result. Global
+ * reductions are always combined per block in block order, which keeps them
+ * independent of scheduling in both modes.
+ *
+ * In incremental mode every boid keeps a Verlet list: the boids within
+ * `radius + skin` when the lists were last gathered, from the grid. While
+ * two boids have each moved less than half the skin since, their distance
+ * changed by less than the skin, so filtering the list by the current
+ * distances finds exactly the neighbors of a fresh query. A boid moving
+ * further, or wrapping around the world, becomes a mover: from then on it
+ * queries the grid every step and the other boids find it through these
+ * queries rather than through their lists. All the lists are gathered again
+ * once movers exceed 1 / `moverLimit` of the boids. The grid is only built
+ * on the steps that have movers.
+ *
+ * With level of detail enabled, only the boids inside the focus rectangle
+ * (usually the visible viewport) are updated every step. The others are
+ * updated every `lodInterval`-th step with a timestep as many times larger,
+ * staggered by ID so that the load is even from one step to the next.
+ *
+ * Static obstacles live in their own immutable index and add an avoidance
+ * term to the steering of the boids that come within `obstacleRadius`.
+ *
+ * When `cohesionRadius` is set, cohesion and alignment are computed over
+ * that larger radius from a Barnes-Hut quadtree (opening angle `theta`),
+ * and the exact neighbors within `radius` are only used for separation.
+ * With species, each species gets its own quadtree.
+ *
+ * With the grid index, the force kernel walks the bin lattice over a
+ * cell-sorted copy of the boids instead of querying the R-tree, which is
+ * then only rebuilt when someone asks for it. In quantized mode that copy
+ * holds 16-bit positions and velocities (see QuantizedStore), halving the
+ * memory traffic of the kernel, while the float state remains the reference
+ * for integration. Otherwise `layout` picks how the float copy is laid
+ * out: one record per boid, one array per coordinate, or blocks of 8 boids
+ * (see AosoaStore). The last two and the quantized copy are read 8
+ * candidates at a time (see LaneSums). The grid kernel does not use the
+ * incremental neighbor lists.
+ *
+ * With species enabled, every species gets its own R-tree. Flocking only
+ * involves boids of the same species, found in their species index, and
+ * the interactions between species query the other indexes with their own
+ * radius: prey flee the predators within `fleeRadius`, predators chase the
+ * nearest prey within `huntRadius` and neutral boids keep the separation
+ * distance from everyone else. This mode always runs on these R-trees and
+ * ignores the index, quantized and incremental settings.
+ *
+ * With sleeping enabled, a boid that stayed slower than `sleepSpeed` with
+ * a small velocity change and the same number of neighbors for `sleepSteps`
+ * steps is put to sleep: its velocity is zeroed and it moves from the
+ * per-step index to a separate sleepers R-tree, updated by insertion and
+ * removal only. Sleeping boids get no forces, no integration and are not
+ * reloaded into the per-step index. A boid faster than `sleepSpeed` wakes
+ * the sleepers within its separation distance, or within its radius once
+ * faster than `wakeSpeed`. Wake-ups and sleeps are applied serially in
+ * block order. Only the default R-tree kernel supports it; other modes
+ * wake everyone up.
+ *
+ * With profiling enabled, the R-tree kernels time the neighbor search of
+ * every boid apart from the steering, so that the force stage can be split
+ * into query and force time. The grid kernel reads the cells inline and
+ * reports no query time.
+ */
+class Flock {
+public:
+    enum class Index { RTree, Grid };
+    enum class Layout { AoS, SoA, AoSoA };
+
+    struct Params {
+        float width = 1000.f;
+        float height = 1000.f;
+        float radius = 50.f;  // Perception radius
+        float separationRadius = 15.f;
+        float minSpeed = 40.f;
+        float maxSpeed = 120.f;
+        float separation = 1500.f;
+        float alignment = 1.f;
+        float cohesion = 0.5f;
+        float avoidance = 800.f;
+        float obstacleRadius = 25.f;
+        float cohesionRadius = 0.f;  // 0 uses the exact neighbors within radius
+        float theta = 0.5f;
+        unsigned threads = std::thread::hardware_concurrency();
+        bool deterministic = false;
+        bool incremental = false;
+        float skin = 5.f;  // Margin of the incremental neighbor lists over radius
+        Index index = Index::RTree;
+        bool quantized = false;  // Implies the grid index
+        Layout layout = Layout::AoS;  // Float copy read by the grid kernel
+        unsigned lodInterval = 1;  // 1 disables level of detail
+        bool species = false;
+        float predatorShare = 0.01f;
+        float neutralShare = 0.1f;
+        float predatorSpeed = 1.3f;  // Relative to maxSpeed
+        float fleeRadius = 80.f;
+        float flee = 600.f;
+        float huntRadius = 150.f;
+        float hunt = 300.f;
+        float drag = 0.f;  // Fraction of the velocity lost per second
+        bool sleeping = false;
+        float sleepSpeed = 5.f;
+        float sleepAcceleration = 300.f;  // Velocity change per second, drag included
+        unsigned sleepSteps = 30;
+        float wakeSpeed = 20.f;
+        bool profiling = false;
+    };
+
+    struct Stats {
+        std::size_t neighbors = 0;  // Sum of neighbor counts over all boids
+        std::size_t queries = 0;    // Index queries issued during the last step
+        std::size_t updated = 0;    // Boids moved during the last step
+        std::size_t sleeping = 0;
+        float meanSpeed = 0.f;
+        float queryShare = 0.f;  // Part of the force stage spent finding neighbors, when profiling
+    };
+
+    // Fixed block size: the partition must not depend on the thread count.
+    static constexpr std::size_t grain = 256;
+
+    explicit Flock(Params params)
+        : params_(params),
+          pool_(std::make_unique<ThreadPool>(params.threads)),
+          focus_{{0.f, 0.f}, {params.width, params.height}},
+          grid_(params.width, params.height, params.radius),
+          lastGrid_(params.width, params.height, params.radius) {}
+
+    void spawn(std::vector<point_2d> const& positions) {
+        boids_.clear();
+        boids_.reserve(positions.size());
+        // Headings a golden angle apart, rotated step by step rather than through std::cos and std::sin, whose
+        // results differ between math libraries
+        const double turnCos = -0.7373688782616119, turnSin = 0.675490294061441;
+        const float speed = 0.5f * (params_.minSpeed + params_.maxSpeed);
+        double headingCos = 1.0, headingSin = 0.0;
+        for (auto const& position : positions) {
+            const auto id = static_cast<std::uint32_t>(boids_.size());
+            const point_2d velocity{static_cast<float>(headingCos) * speed, static_cast<float>(headingSin) * speed};
+            boids_.push_back({position, velocity, id, speciesOf(id)});
+            const double rotated = headingCos * turnCos - headingSin * turnSin;
+            headingSin = headingSin * turnCos + headingCos * turnSin;
+            headingCos = rotated;
+        }
+        acceleration_.assign(boids_.size(), {});
+        timestep_.assign(boids_.size(), 0.f);
+        reference_.assign(boids_.size(), {});
+        mover_.assign(boids_.size(), 0);
+        movers_.clear();
+        neighborCount_.assign(boids_.size(), 0);
+        steady_.assign(boids_.size(), 0);
+        calm_.assign(boids_.size(), 0);
+        asleep_.assign(boids_.size(), 0);
+        sleepers_.clear();
+        refresh_ = true;
+        steps_ = 0;
+        rebuildIndex();
+        std::swap(tree_, nextTree_);
+        treeStale_ = false;
+        culling_ = Culling::Tree;
+        moved_ = 0.f;
+        woken_.clear();
+        hash_ = stateHash();
+    }
+
+    void step(float dt) {
+        prepare(dt);
+        computeForces();
+        integrate();
+    }
+
+    /**
+     * The stages of a step, to be called in this order. Only integrate()
+     * modifies the boids, so the state of the previous step can still be
+     * read while the other two are running, and so can cull(): the
+     * structures built during a step are only swapped in by integrate().
+     */
+    void prepare(float dt) {
+        if (usesTree() && !params_.incremental)
+            rebuildIndex();
+        else
+            treeStale_ = true;  // The incremental mode finds its candidates in the grid
+        if (params_.cohesionRadius > 0.f && !params_.species) quadtree_.build(boids_);
+        schedule(dt);
+    }
+
+    void computeForces() {
+        if (params_.species) return computeForcesSpecies();
+        if (params_.quantized) return computeForcesGrid(quantized_);
+        if (params_.index == Index::Grid) {
+            switch (params_.layout) {
+                case Layout::SoA: return computeForcesGrid(soa_);
+                case Layout::AoSoA: return computeForcesGrid(aosoa_);
+                default: return computeForcesGrid(floats_);
+            }
+        }
+        const bool incremental = params_.incremental;
+        const bool sleeping = sleeps();
+        const bool profiling = params_.profiling;
+        partials_.assign(ThreadPool::blockCount(boids_.size(), grain), {});
+        if (incremental) updateLists();
+        pool_->parallelFor(boids_.size(), grain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            thread_local std::vector<Boid const*> scratch;
+            auto& partial = partials_[b];
+            const auto blockStart = profiling ? clock::now() : clock::time_point();
+            for (std::size_t i = begin; i < end; ++i) {
+                if (timestep_[i] == 0.f) continue;
+                scratch.clear();
+                const auto queryStart = profiling ? clock::now() : clock::time_point();
+                if (incremental) {
+                    listedNeighbors(i, scratch, partial);
+                } else {
+                    neighbors(nextTree_, boids_[i].position, params_.radius, scratch);
+                    if (sleeping) wakeNeighbors(boids_[i], scratch, partial);
+                    if (params_.deterministic) sortById(scratch);
+                    partial.neighbors += scratch.size() - 1;  // The query also returns the boid itself
+                    ++partial.queries;
+                }
+                if (profiling) partial.queryTime += since(queryStart);
+                const auto count = static_cast<std::uint32_t>(scratch.size());
+                steady_[i] = count == neighborCount_[i];
+                neighborCount_[i] = count;
+                acceleration_[i] = steer(boids_[i], scratch);
+            }
+            if (profiling) partial.time = since(blockStart);
+        });
+    }
+
+    void integrate() {
+        const bool sleeping = sleeps();
+        const bool listed = params_.incremental && usesTree();
+        const float halfSkin2 = 0.25f * params_.skin * params_.skin;
+        woken_.clear();
+        if (!sleeping && !sleepers_.empty()) wakeAll();
+        if (sleeping)
+            for (auto const& partial : partials_)
+                for (auto id : partial.woken) wake(id);
+
+        pool_->parallelFor(boids_.size(), grain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            float speeds = 0.f, moved = 0.f;
+            std::size_t updated = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+                if (timestep_[i] == 0.f) {
+                    speeds += boids_[i].velocity.length();
+                    continue;
+                }
+                const Vec2 before = boids_[i].velocity;
+                const float speed = advance(boids_[i], acceleration_[i], timestep_[i]);
+                speeds += speed;
+                moved = std::max(moved, speed * timestep_[i]);
+                ++updated;
+                if (sleeping && settle(i, speed, (boids_[i].velocity - before) / timestep_[i]))
+                    partials_[b].asleep.push_back(static_cast<std::uint32_t>(i));
+                if (listed && !mover_[i] && (boids_[i].position - reference_[i]).lengthSquared() >= halfSkin2)
+                    partials_[b].movers.push_back(static_cast<std::uint32_t>(i));
+            }
+            partials_[b].speed = speeds;
+            partials_[b].moved = moved;
+            partials_[b].updated = updated;
+        });
+
+        // Falling asleep after the parallel loop, in block order
+        for (auto const& partial : partials_)
+            for (auto i : partial.asleep) {
+                boids_[i].velocity = {};
+                asleep_[i] = 1;
+                sleepers_.insert(boids_[i]);
+            }
+        for (auto const& partial : partials_)
+            for (auto i : partial.movers) {
+                movers_.push_back(i);
+                mover_[i] = static_cast<std::uint32_t>(movers_.size());
+            }
+
+        // Combine the partials in block order, whatever thread produced them
+        stats_ = {};
+        float speeds = 0.f;
+        double queryTime = 0.0, time = 0.0;
+        moved_ = 0.f;
+        for (auto const& partial : partials_) {
+            stats_.neighbors += partial.neighbors;
+            stats_.queries += partial.queries;
+            stats_.updated += partial.updated;
+            speeds += partial.speed;
+            moved_ = std::max(moved_, partial.moved);
+            queryTime += partial.queryTime;
+            time += partial.time;
+        }
+        stats_.meanSpeed = boids_.empty() ? 0.f : speeds / static_cast<float>(boids_.size());
+        stats_.queryShare = time > 0.0 ? static_cast<float>(queryTime / time) : 0.f;
+        stats_.sleeping = sleepers_.size();
+        publish();
+        ++steps_;
+        if (params_.deterministic) hash_ = stateHash();
+    }
+
+    void setThreads(unsigned threads) {
+        params_.threads = threads;
+        pool_ = std::make_unique<ThreadPool>(threads);
+    }
+    void setDeterministic(bool enabled) {
+        params_.deterministic = enabled;
+        refresh_ = true;  // The neighbor lists are only sorted in deterministic mode
+    }
+    void setLevelOfDetail(unsigned interval) { params_.lodInterval = std::max(1u, interval); }
+    void setIndex(Index index) { params_.index = index; }
+    void setQuantized(bool enabled) { params_.quantized = enabled; }
+    void setLayout(Layout layout) { params_.layout = layout; }
+    void setSpecies(bool enabled) { params_.species = enabled; }
+    void setCohesionRadius(float radius) { params_.cohesionRadius = radius; }
+    void setFocus(box const& focus) { focus_ = focus; }
+    void setObstacles(Obstacles obstacles) { obstacles_ = std::move(obstacles); }
+    void setSleeping(bool enabled) { params_.sleeping = enabled; }
+    void setDrag(float drag) { params_.drag = drag; }
+    void setMinSpeed(float speed) { params_.minSpeed = speed; }
+    void setProfiling(bool enabled) { params_.profiling = enabled; }
+    void setIncremental(bool enabled) {
+        params_.incremental = enabled;
+        refresh_ = true;
+    }
+
+    Params const& params() const { return params_; }
+    std::vector<Boid> const& boids() const { return boids_; }
+    // Sleeping boids, which are not in index()
+    boid_rtree const& sleepers() const { return sleepers_; }
+    boid_rtree const& index(Species species) const { return lastSpeciesTrees_[slot(species)]; }
+    // R-tree of the awake boids at the start of the last step, only built on demand outside the R-tree mode
+    boid_rtree const& index() const {
+        if (treeStale_) {
+            tree_ = boid_rtree(boids_.begin(), boids_.end());
+            treeStale_ = false;
+        }
+        return tree_;
+    }
+    // Bytes per boid read by the grid force kernel
+    std::size_t storeBytes() const {
+        if (params_.quantized) return quantized_.bytes();
+        switch (params_.layout) {
+            case Layout::SoA: return soa_.bytes();
+            case Layout::AoSoA: return aosoa_.bytes();
+            default: return floats_.bytes();
+        }
+    }
+    // Bin lattice of the last step that built one: every grid kernel step, incremental steps with movers
+    Grid const& grid() const { return lastGrid_; }
+
+    /**
+     * Appends the boids inside `area` to `out`, in their current state.
+     * Unlike index(), this may run while prepare() and computeForces() do:
+     * the candidates come from whichever structure held every boid during
+     * the last step, searched with a margin of the farthest a boid moved
+     * since. A boid that wrapped around the world is missed once.
+     */
+    void cull(box const& area, std::vector<Boid>& out) const {
+        box padded = area;
+        padded.min_corner() -= Vec2{moved_, moved_};
+        padded.max_corner() += Vec2{moved_, moved_};
+        auto keep = [&](std::uint32_t i) {
+            if (bg::covered_by(boids_[i].position, area)) out.push_back(boids_[i]);
+        };
+        auto search = [&](boid_rtree const& tree, auto&& visit) {
+            tree.query(bgi::intersects(padded), boost::make_function_output_iterator(visit));
+        };
+        switch (culling_) {
+            case Culling::Tree:
+                // Boids that fell asleep during the step are in both trees, those woken up in neither
+                search(tree_, [&](Boid const& boid) {
+                    if (!asleep_[boid.id]) keep(boid.id);
+                });
+                search(sleepers_, [&](Boid const& boid) { keep(boid.id); });
+                for (auto id : woken_) keep(id);
+                break;
+            case Culling::Species:
+                for (auto const& tree : lastSpeciesTrees_) search(tree, [&](Boid const& boid) { keep(boid.id); });
+                break;
+            case Culling::Grid:
+                for (int y = lastGrid_.row(padded.min_corner().y); y <= lastGrid_.row(padded.max_corner().y); ++y)
+                    for (int x = lastGrid_.column(padded.min_corner().x); x <= lastGrid_.column(padded.max_corner().x);
+                         ++x)
+                        for (auto i : lastGrid_.members(static_cast<std::uint32_t>(y * lastGrid_.columns() + x)))
+                            keep(i);
+                break;
+        }
+    }
+    box const& focus() const { return focus_; }
+    Obstacles const& obstacles() const { return obstacles_; }
+    Stats const& stats() const { return stats_; }
+    std::uint64_t steps() const { return steps_; }
+    std::uint64_t hash() const { return hash_; }
+    ThreadPool& pool() { return *pool_; }
+
+    /**
+     * FNV-1a over the bit patterns of every position and velocity, in ID
+     * order. Two runs agree on this value only if they are bitwise equal.
+     */
+    std::uint64_t stateHash() const {
+        std::uint64_t h = 0xcbf29ce484222325ull;
+        auto mix = [&h](std::uint32_t word) {
+            for (int i = 0; i < 4; ++i, word >>= 8) h = (h ^ (word & 0xff)) * 0x100000001b3ull;
+        };
+        for (auto const& boid : boids_) {
+            mix(boid.id);
+            mix(std::bit_cast<std::uint32_t>(boid.position.x));
+            mix(std::bit_cast<std::uint32_t>(boid.position.y));
+            mix(std::bit_cast<std::uint32_t>(boid.velocity.x));
+            mix(std::bit_cast<std::uint32_t>(boid.velocity.y));
+        }
+        return h;
+    }
+
+private:
+    struct Partial {
+        std::size_t neighbors = 0;
+        std::size_t queries = 0;
+        std::size_t updated = 0;
+        float speed = 0.f;
+        float moved = 0.f;
+        double queryTime = 0.0;  // Seconds, profiling only
+        double time = 0.0;
+        std::vector<std::uint32_t> woken;  // Sleepers to wake up before integration
+        std::vector<std::uint32_t> asleep;  // Boids falling asleep after integration
+        std::vector<std::uint32_t> movers;  // Boids that moved half the skin since their list was gathered
+    };
+
+    // ID lists of consecutive items, one vector per block of `grain` items so that blocks are filled in parallel
+    struct BlockLists {
+        std::vector<std::vector<std::uint32_t>> blocks;
+        std::vector<std::uint32_t> ends;  // End of the list of each item within its block
+
+        std::span<std::uint32_t const> operator[](std::size_t k) const {
+            auto const& block = blocks[k / grain];
+            const std::uint32_t begin = k % grain ? ends[k - 1] : 0;
+            return {block.data() + begin, block.data() + ends[k]};
+        }
+    };
+
+    // Movers allowed before all the lists are gathered again, as a fraction 1 / moverLimit of the boids
+    static constexpr std::size_t moverLimit = 8;
+
+    using clock = std::chrono::steady_clock;
+
+    static double since(clock::time_point start) {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    bool usesTree() const {
+        return params_.index == Index::RTree && !params_.quantized && !params_.species;
+    }
+
+    static constexpr std::size_t slot(Species species) { return static_cast<std::size_t>(species); }
+
+    // Species are spread over the IDs with a multiplicative hash
+    Species speciesOf(std::uint32_t id) const {
+        const float u = static_cast<float>((id * 2654435761u) >> 8) * 0x1.0p-24f;
+        if (u < params_.predatorShare) return Species::Predator;
+        if (u < params_.predatorShare + params_.neutralShare) return Species::Neutral;
+        return Species::Prey;
+    }
+
+    // Into nextTree_, the sleepers are only left out while they stay asleep
+    void rebuildIndex() {
+        if (sleepers_.empty() || !sleeps()) {
+            nextTree_ = boid_rtree(boids_.begin(), boids_.end());
+        } else {
+            awake_.clear();
+            for (std::size_t i = 0; i < boids_.size(); ++i)
+                if (!asleep_[i]) awake_.push_back(boids_[i]);
+            nextTree_ = boid_rtree(awake_.begin(), awake_.end());
+        }
+    }
+
+    // Swaps in the structure built during the step, from which cull() then reads
+    void publish() {
+        if (params_.species) {
+            std::swap(speciesTrees_, lastSpeciesTrees_);
+            culling_ = Culling::Species;
+        } else if (usesTree() && !params_.incremental) {
+            std::swap(tree_, nextTree_);
+            treeStale_ = false;
+            culling_ = Culling::Tree;
+        } else if (usesTree()) {
+            // Without a new grid, the last one was built when the lists were gathered and only the new movers
+            // went further than half the skin since
+            if (gridBuilt_)
+                std::swap(grid_, lastGrid_);
+            else
+                moved_ += 0.5f * params_.skin;
+            culling_ = Culling::Grid;
+            return;
+        } else {
+            std::swap(grid_, lastGrid_);
+            culling_ = Culling::Grid;
+        }
+        refresh_ = true;  // The neighbor lists only follow the incremental steps
+    }
+
+    bool sleeps() const { return params_.sleeping && usesTree() && !params_.incremental; }
+
+    /**
+     * Adds the sleepers near `self` to its neighbors and flags the ones it
+     * disturbs: those within the separation distance if `self` is not calm,
+     * and all of them if it is faster than `wakeSpeed`.
+     */
+    void wakeNeighbors(Boid const& self, std::vector<Boid const*>& out, Partial& partial) const {
+        if (sleepers_.empty()) return;
+        const std::size_t awake = out.size();
+        neighbors(sleepers_, self.position, params_.radius, out);
+        const float speed2 = self.velocity.lengthSquared();
+        if (speed2 < params_.sleepSpeed * params_.sleepSpeed) return;
+        const float reach = speed2 < params_.wakeSpeed * params_.wakeSpeed ? params_.separationRadius : params_.radius;
+        for (std::size_t k = awake; k < out.size(); ++k)
+            if ((out[k]->position - self.position).lengthSquared() < reach * reach) partial.woken.push_back(out[k]->id);
+    }
+
+    void wake(std::uint32_t i) {
+        if (!asleep_[i]) return;  // Several boids may wake the same sleeper
+        sleepers_.remove(boids_[i]);
+        asleep_[i] = 0;
+        calm_[i] = 0;
+        woken_.push_back(i);
+    }
+
+    // Once sleeping is off, the step already indexed the sleepers with the others
+    void wakeAll() {
+        sleepers_.clear();
+        std::fill(asleep_.begin(), asleep_.end(), 0);
+        std::fill(calm_.begin(), calm_.end(), 0);
+    }
+
+    /**
+     * Counts the consecutive calm steps of boid i and tells whether it should
+     * fall asleep. `change` is the velocity change over the step, drag
+     * included: in a settled group the steering forces do not vanish, they
+     * balance each other.
+     */
+    bool settle(std::size_t i, float speed, Vec2 change) {
+        const bool calm = speed < params_.sleepSpeed &&
+                          change.lengthSquared() < params_.sleepAcceleration * params_.sleepAcceleration &&
+                          steady_[i];
+        calm_[i] = calm ? calm_[i] + 1 : 0;
+        return calm_[i] >= params_.sleepSteps;
+    }
+
+    void computeForcesSpecies() {
+        for (auto& bucket : speciesBoids_) bucket.clear();
+        for (auto const& boid : boids_) speciesBoids_[slot(boid.species)].push_back(boid);
+        for (std::size_t s = 0; s < speciesTrees_.size(); ++s)
+            speciesTrees_[s] = boid_rtree(speciesBoids_[s].begin(), speciesBoids_[s].end());
+        if (params_.cohesionRadius > 0.f)
+            for (std::size_t s = 0; s < speciesQuadtrees_.size(); ++s) speciesQuadtrees_[s].build(speciesBoids_[s]);
+
+        const bool profiling = params_.profiling;
+        partials_.assign(ThreadPool::blockCount(boids_.size(), grain), {});
+        pool_->parallelFor(boids_.size(), grain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            thread_local std::vector<Boid const*> scratch;
+            auto& partial = partials_[b];
+            const auto blockStart = profiling ? clock::now() : clock::time_point();
+            for (std::size_t i = begin; i < end; ++i) {
+                if (timestep_[i] == 0.f) continue;
+                Boid const& self = boids_[i];
+                scratch.clear();
+                const auto queryStart = profiling ? clock::now() : clock::time_point();
+                neighbors(speciesTrees_[slot(self.species)], self.position, params_.radius, scratch);
+                if (params_.deterministic) sortById(scratch);
+                if (profiling) partial.queryTime += since(queryStart);
+                partial.neighbors += scratch.size() - 1;
+                ++partial.queries;
+                acceleration_[i] = steer(self, scratch);
+
+                // The queries of the other species stay in the force time
+                scratch.clear();
+                acceleration_[i] += interact(self, scratch);
+            }
+            if (profiling) partial.time = since(blockStart);
+        });
+    }
+
+    // Acceleration caused by the other species, `scratch` is a work buffer
+    Vec2 interact(Boid const& self, std::vector<Boid const*>& scratch) const {
+        auto repel = [&](Species other, float radius) {
+            scratch.clear();
+            neighbors(speciesTrees_[slot(other)], self.position, radius, scratch);
+            if (params_.deterministic) sortById(scratch);
+            Vec2 push;
+            for (Boid const* threat : scratch) {
+                const Vec2 away = self.position - threat->position;
+                const float d = away.length();
+                if (d > 0.f) push += away * ((radius - d) / (radius * d));
+            }
+            return push;
+        };
+        switch (self.species) {
+            case Species::Prey: return repel(Species::Predator, params_.fleeRadius) * params_.flee;
+            case Species::Predator: {
+                auto const& prey = speciesTrees_[slot(Species::Prey)];
+                for (auto it = prey.qbegin(bgi::nearest(self.position, 1)); it != prey.qend(); ++it) {
+                    const Vec2 chase = it->position - self.position;
+                    const float d = chase.length();
+                    if (d < params_.huntRadius && d > 0.f) return chase * (params_.hunt / d);
+                }
+                return {};
+            }
+            case Species::Neutral: {
+                const float r = params_.separationRadius;
+                return (repel(Species::Prey, r) + repel(Species::Predator, r)) * (params_.separation / r);
+            }
+        }
+        return {};
+    }
+
+    // Cell by cell: each boid reads the 3x3 block of cells around its own from the store
+    template <class Store>
+    void computeForcesGrid(Store& store) {
+        static constexpr std::size_t cellGrain = 16;
+        grid_.build(boids_);
+        store.build(grid_, boids_, params_.maxSpeed);
+        partials_.assign(std::max(ThreadPool::blockCount(boids_.size(), grain),
+                                  ThreadPool::blockCount(grid_.cells(), cellGrain)),
+                         {});
+        const float r2 = params_.radius * params_.radius;
+        const float separation2 = params_.separationRadius * params_.separationRadius;
+        pool_->parallelFor(grid_.cells(), cellGrain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            auto& partial = partials_[b];
+            for (auto c = static_cast<std::uint32_t>(begin); c < end; ++c) {
+                if constexpr (Store::lanewise)
+                    if (grid_.count(c) > 0) store.stage(grid_, c);
+                std::uint32_t slot = grid_.begin(c);
+                for (auto i : grid_.members(c)) {
+                    const std::uint32_t self = slot++;
+                    if (timestep_[i] == 0.f) continue;
+                    Boid const& boid = boids_[i];
+                    Vec2 separation;
+                    Aggregate local;
+                    if constexpr (Store::lanewise) {
+                        LaneSums sums;
+                        grid_.forEachAdjacent(c, [&](std::uint32_t n) {
+                            store.gather(n, grid_.begin(n), grid_.begin(n) + grid_.count(n), self, boid.position,
+                                         r2, separation2, sums);
+                        });
+                        for (std::uint32_t l = 0; l < LaneSums::lanes; ++l) {
+                            local.count += static_cast<std::uint32_t>(sums.count[l]);
+                            local.position += Vec2{sums.x[l], sums.y[l]};
+                            local.velocity += Vec2{sums.vx[l], sums.vy[l]};
+                            separation += Vec2{sums.separationX[l], sums.separationY[l]};
+                        }
+                    } else {
+                        grid_.forEachAdjacent(c, [&](std::uint32_t n) {
+                            const Vec2 origin = store.origin(n);
+                            for (std::uint32_t s = grid_.begin(n), e = s + grid_.count(n); s < e; ++s) {
+                                if (s == self) continue;
+                                const point_2d position = store.position(store[s], origin);
+                                if ((position - boid.position).lengthSquared() >= r2) continue;
+                                accumulate(boid, position, store.velocity(store[s]), separation, local);
+                            }
+                        });
+                    }
+                    acceleration_[i] = respond(boid, separation, local);
+                    partial.neighbors += local.count;
+                    ++partial.queries;
+                }
+            }
+        });
+    }
+
+    static void sortById(std::vector<Boid const*>& list) {
+        std::sort(list.begin(), list.end(), [](Boid const* a, Boid const* b) { return a->id < b->id; });
+    }
+
+    /**
+     * Gathers all the neighbor lists again if needed, otherwise lets the
+     * movers query the grid and hands each of their neighbors, in `extras_`,
+     * the movers it has to add to its own list.
+     */
+    void updateLists() {
+        const std::size_t n = boids_.size();
+        const bool gather = refresh_ || movers_.size() * moverLimit > n;
+        gridBuilt_ = gather || !movers_.empty();
+        if (!gridBuilt_) return;
+        grid_.build(boids_);
+        if (gather) {
+            for (std::size_t i = 0; i < n; ++i) reference_[i] = boids_[i].position;
+            std::fill(mover_.begin(), mover_.end(), 0);
+            movers_.clear();
+            gatherLists(lists_, n, [](std::size_t i) { return static_cast<std::uint32_t>(i); },
+                        params_.radius + params_.skin);
+            refresh_ = false;
+            return;
+        }
+
+        gatherLists(moverLists_, movers_.size(), [&](std::size_t k) { return movers_[k]; }, params_.radius);
+        extraStart_.assign(n + 1, 0);
+        for (std::size_t k = 0; k < movers_.size(); ++k)
+            for (auto other : moverLists_[k])
+                if (!mover_[other]) ++extraStart_[other + 1];
+        for (std::size_t i = 1; i <= n; ++i) extraStart_[i] += extraStart_[i - 1];
+        extras_.resize(extraStart_[n]);
+        extraCursor_.assign(extraStart_.begin(), extraStart_.end() - 1);
+        for (std::size_t k = 0; k < movers_.size(); ++k)
+            for (auto other : moverLists_[k])
+                if (!mover_[other]) extras_[extraCursor_[other]++] = movers_[k];
+    }
+
+    // Fills lists[k] with the boids of grid_ within `reach` of boid idOf(k), for every k below count
+    template <class IdOf>
+    void gatherLists(BlockLists& lists, std::size_t count, IdOf idOf, float reach) {
+        lists.blocks.resize(ThreadPool::blockCount(count, grain));
+        lists.ends.resize(count);
+        const float reach2 = reach * reach;
+        pool_->parallelFor(count, grain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            auto& block = lists.blocks[b];
+            block.clear();
+            for (std::size_t k = begin; k < end; ++k) {
+                const std::uint32_t self = idOf(k);
+                const point_2d p = boids_[self].position;
+                const std::size_t first = block.size();
+                for (int y = grid_.row(p.y - reach); y <= grid_.row(p.y + reach); ++y)
+                    for (int x = grid_.column(p.x - reach); x <= grid_.column(p.x + reach); ++x)
+                        for (auto other : grid_.members(static_cast<std::uint32_t>(y * grid_.columns() + x)))
+                            if (other != self && (boids_[other].position - p).lengthSquared() < reach2)
+                                block.push_back(other);
+                if (params_.deterministic) std::sort(block.begin() + first, block.end());
+                lists.ends[k] = static_cast<std::uint32_t>(block.size());
+                ++partials_[b].queries;
+            }
+        });
+    }
+
+    // Neighbors of boid i: a mover's own query, otherwise its list without the movers, plus the movers near it
+    void listedNeighbors(std::size_t i, std::vector<Boid const*>& out, Partial& partial) const {
+        if (mover_[i]) {
+            for (auto id : moverLists_[mover_[i] - 1]) out.push_back(&boids_[id]);
+        } else {
+            const point_2d p = boids_[i].position;
+            const float r2 = params_.radius * params_.radius;
+            if (movers_.empty()) {
+                for (auto id : lists_[i])
+                    if ((boids_[id].position - p).lengthSquared() < r2) out.push_back(&boids_[id]);
+            } else {
+                for (auto id : lists_[i])
+                    if (!mover_[id] && (boids_[id].position - p).lengthSquared() < r2) out.push_back(&boids_[id]);
+            }
+            if (!movers_.empty() && extraStart_[i] < extraStart_[i + 1]) {
+                for (auto k = extraStart_[i]; k < extraStart_[i + 1]; ++k) out.push_back(&boids_[extras_[k]]);
+                if (params_.deterministic) sortById(out);
+            }
+        }
+        partial.neighbors += out.size();
+    }
+
+    Vec2 steer(Boid const& self, std::span<Boid const* const> around) const {
+        Vec2 separation;
+        Aggregate local;
+        for (Boid const* other : around)
+            if (other->id != self.id) accumulate(self, other->position, other->velocity, separation, local);
+        return respond(self, separation, local);
+    }
+
+    void accumulate(Boid const& self, point_2d const& position, Vec2 const& velocity,
+                    Vec2& separation, Aggregate& local) const {
+        const Vec2 offset = self.position - position;
+        const float d2 = offset.lengthSquared();
+        if (d2 < params_.separationRadius * params_.separationRadius && d2 > 0.f)
+            separation += offset / d2;
+        local.add(position, velocity);
+    }
+
+    // Acceleration from the accumulated neighborhood, plus the long-range and obstacle terms
+    Vec2 respond(Boid const& self, Vec2 const& separation, Aggregate const& local) const {
+        Vec2 acceleration = separation * params_.separation;
+        Aggregate group = local;
+        if (params_.cohesionRadius > 0.f) {
+            Quadtree const& tree = params_.species ? speciesQuadtrees_[slot(self.species)] : quadtree_;
+            group = tree.approximate(self.position, params_.cohesionRadius, params_.theta);
+            group -= self;
+        }
+        if (group.count > 0)
+            acceleration += (group.meanVelocity() - self.velocity) * params_.alignment +
+                            (group.centerOfMass() - self.position) * params_.cohesion;
+        if (!obstacles_.empty())
+            acceleration += obstacles_.avoid(self.position, params_.obstacleRadius) * params_.avoidance;
+        return acceleration;
+    }
+
+    // Timestep of every boid for this step, zero for boids left as they are
+    void schedule(float dt) {
+        const unsigned k = params_.lodInterval;
+        const auto phase = static_cast<std::uint32_t>(steps_ % k);
+        pool_->parallelFor(boids_.size(), grain, [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                if (asleep_[i])
+                    timestep_[i] = 0.f;
+                else if (k == 1 || bg::covered_by(boids_[i].position, focus_))
+                    timestep_[i] = dt;
+                else
+                    timestep_[i] = boids_[i].id % k == phase ? dt * static_cast<float>(k) : 0.f;
+            }
+        });
+    }
+
+    // Moves one boid and returns its new speed. The world wraps around.
+    float advance(Boid& boid, Vec2 acceleration, float dt) const {
+        const float maxSpeed = params_.species && boid.species == Species::Predator
+                                   ? params_.maxSpeed * params_.predatorSpeed
+                                   : params_.maxSpeed;
+        boid.velocity += acceleration * dt;
+        if (params_.drag > 0.f) boid.velocity *= std::max(0.f, 1.f - params_.drag * dt);
+        float speed = boid.velocity.length();
+        if (speed > maxSpeed) {
+            boid.velocity *= maxSpeed / speed;
+            speed = maxSpeed;
+        } else if (speed < params_.minSpeed && speed > 0.f) {
+            boid.velocity *= params_.minSpeed / speed;
+            speed = params_.minSpeed;
+        }
+        boid.position += boid.velocity * dt;
+        boid.position.x -= params_.width * std::floor(boid.position.x / params_.width);
+        boid.position.y -= params_.height * std::floor(boid.position.y / params_.height);
+        return speed;
+    }
+
+    Params params_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<Boid> boids_;
+    std::vector<Vec2> acceleration_;
+    std::vector<float> timestep_;
+    std::vector<Partial> partials_;
+    enum class Culling { Tree, Grid, Species };  // Structure of the last step holding every boid
+
+    mutable boid_rtree tree_;
+    boid_rtree nextTree_;  // Built by prepare() for the forces, swapped into tree_ by integrate()
+    boid_rtree sleepers_;
+    std::vector<std::uint32_t> woken_;  // Sleepers woken up by the last integrate(), missing from tree_
+    std::vector<Boid> awake_;
+    std::vector<std::uint32_t> neighborCount_;
+    std::vector<std::uint8_t> steady_;  // Same number of neighbors as in the previous step
+    std::vector<std::uint16_t> calm_;  // Consecutive calm steps
+    std::vector<std::uint8_t> asleep_;
+    std::array<std::vector<Boid>, 3> speciesBoids_;
+    std::array<boid_rtree, 3> speciesTrees_;
+    std::array<boid_rtree, 3> lastSpeciesTrees_;
+    mutable bool treeStale_ = false;
+    Culling culling_ = Culling::Tree;
+    float moved_ = 0.f;  // Farthest a boid moved during the last step
+    box focus_;
+    Obstacles obstacles_;
+    Grid grid_;
+    Grid lastGrid_;
+    Quadtree quadtree_;
+    std::array<Quadtree, 3> speciesQuadtrees_;
+    FloatStore floats_;
+    SoaStore soa_;
+    AosoaStore aosoa_;
+    QuantizedStore quantized_;
+    // Incremental mode
+    BlockLists lists_;  // Boids within radius + skin of each boid, at its reference position
+    std::vector<point_2d> reference_;  // Positions when the lists were gathered
+    std::vector<std::uint32_t> mover_;  // 1 + slot in movers_, 0 for the boids still covered by the lists
+    std::vector<std::uint32_t> movers_;
+    BlockLists moverLists_;  // Boids within radius of each mover, this step
+    std::vector<std::uint32_t> extraStart_;  // Movers of extras_ near each boid, in CSR form
+    std::vector<std::uint32_t> extraCursor_;
+    std::vector<std::uint32_t> extras_;
+    bool gridBuilt_ = false;  // By the last updateLists()
+    bool refresh_ = true;  // The lists must be gathered again
+    Stats stats_;
+    std::uint64_t steps_ = 0;
+    std::uint64_t hash_ = 0;
+};
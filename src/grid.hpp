@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "boid.hpp"
+
+/**
+ * Bin lattice over the world: boid indices are counting-sorted by cell so
+ * that each cell is a contiguous range. With a cell size at least equal to
+ * the query radius, a neighbor search only has to visit the 3x3 block of
+ * cells around the query point.
+ *
+ * The number of cells grows with the inverse square of the cell size, so
+ * callers taking the size from the user check cellCount() first.
+ */
+class Grid {
+public:
+    Grid(float width, float height, float cell)
+        : cell_(cell), columns_(span(width, cell)), rows_(span(height, cell)), start_(cells() + 1, 0) {}
+
+    // Cells of a grid of that size, saturated at the largest std::size_t instead of overflowing
+    static std::size_t cellCount(float width, float height, float cell) {
+        const double cells = static_cast<double>(span(width, cell)) * static_cast<double>(span(height, cell));
+        constexpr auto limit = static_cast<double>(std::numeric_limits<std::size_t>::max());
+        return cells >= limit ? std::numeric_limits<std::size_t>::max() : static_cast<std::size_t>(cells);
+    }
+
+    int columns() const { return columns_; }
+    int rows() const { return rows_; }
+    std::size_t cells() const { return static_cast<std::size_t>(columns_) * static_cast<std::size_t>(rows_); }
+    float cellSize() const { return cell_; }
+
+    int column(float x) const { return std::clamp(static_cast<int>(x / cell_), 0, columns_ - 1); }
+    int row(float y) const { return std::clamp(static_cast<int>(y / cell_), 0, rows_ - 1); }
+    std::uint32_t cellOf(point_2d const& p) const {
+        return static_cast<std::uint32_t>(row(p.y) * columns_ + column(p.x));
+    }
+
+    void build(std::span<Boid const> boids) {
+        std::fill(start_.begin(), start_.end(), 0);
+        for (auto const& boid : boids) ++start_[cellOf(boid.position) + 1];
+        for (std::size_t c = 1; c < start_.size(); ++c) start_[c] += start_[c - 1];
+        order_.resize(boids.size());
+        cursor_.assign(start_.begin(), start_.end() - 1);
+        for (std::size_t i = 0; i < boids.size(); ++i)
+            order_[cursor_[cellOf(boids[i].position)]++] = static_cast<std::uint32_t>(i);
+    }
+
+    // Indices of the boids in cell c, in increasing index order
+    std::span<std::uint32_t const> members(std::uint32_t c) const {
+        return {order_.data() + start_[c], order_.data() + start_[c + 1]};
+    }
+    std::uint32_t count(std::uint32_t c) const { return start_[c + 1] - start_[c]; }
+    // Position of the first boid of cell c in the cell-sorted order
+    std::uint32_t begin(std::uint32_t c) const { return start_[c]; }
+
+    // Calls f(cell) for every cell of the 3x3 block centered on c
+    template <class F>
+    void forEachAdjacent(std::uint32_t c, F&& f) const {
+        const int cx = static_cast<int>(c) % columns_;
+        const int cy = static_cast<int>(c) / columns_;
+        for (int y = std::max(0, cy - 1); y <= std::min(rows_ - 1, cy + 1); ++y)
+            for (int x = std::max(0, cx - 1); x <= std::min(columns_ - 1, cx + 1); ++x)
+                f(static_cast<std::uint32_t>(y * columns_ + x));
+    }
+
+private:
+    // Cells along one side, clamped to the int range the cell coordinates are computed in
+    static int span(float length, float cell) {
+        const double cells = std::ceil(static_cast<double>(length) / static_cast<double>(cell));
+        return static_cast<int>(std::clamp(cells, 1.0, static_cast<double>(std::numeric_limits<int>::max())));
+    }
+
+    float cell_;
+    int columns_;
+    int rows_;
+    std::vector<std::uint32_t> start_;  // Prefix sums of the cell counts
+    std::vector<std::uint32_t> cursor_;
+    std::vector<std::uint32_t> order_;
+};
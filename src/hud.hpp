@@ -0,0 +1,115 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+/**
+ * Rolling graphs of per-frame measurements, one panel per series stacked
+ * in a screen rectangle. Each series keeps its last `samples` values in a
+ * ring buffer and is scaled to the next 1, 2 or 5 power of ten above its
+ * maximum over that window.
+ *
+ * The panels and the curves are two vertex arrays sized once in the
+ * constructor and rewritten in place every frame, so the graphs cost two
+ * draw calls whatever the number of samples, plus one text per series.
+ */
+class PerfGraphs {
+public:
+    struct Series {
+        char const* name;
+        char const* unit;  // Appended to the values, with its leading space
+        sf::Color color;
+    };
+
+    PerfGraphs(std::vector<Series> series, sf::Font const& font, sf::FloatRect area, std::size_t samples = 240)
+        : series_(std::move(series)),
+          samples_(std::max<std::size_t>(samples, 2)),
+          values_(series_.size() * samples_, 0.f),
+          heads_(series_.size(), 0),
+          panels_(sf::Quads, series_.size() * 4),
+          curves_(sf::Lines, series_.size() * (samples_ - 1) * 2),
+          labels_(series_.size()) {
+        const float height = area.height / static_cast<float>(series_.size());
+        for (std::size_t s = 0; s < series_.size(); ++s) {
+            const sf::FloatRect panel(area.left, area.top + height * static_cast<float>(s), area.width, height - gap);
+            rects_.push_back(panel);
+            sf::Vertex* quad = &panels_[s * 4];
+            quad[0] = {{panel.left, panel.top}, background};
+            quad[1] = {{panel.left + panel.width, panel.top}, background};
+            quad[2] = {{panel.left + panel.width, panel.top + panel.height}, background};
+            quad[3] = {{panel.left, panel.top + panel.height}, background};
+            for (std::size_t k = 0; k < (samples_ - 1) * 2; ++k)
+                curves_[s * (samples_ - 1) * 2 + k].color = series_[s].color;
+            labels_[s].setFont(font);
+            labels_[s].setCharacterSize(12);
+            labels_[s].setFillColor(series_[s].color);
+            labels_[s].setPosition(panel.left + 4.f, panel.top + 2.f);
+        }
+    }
+
+    // Appends a value to series s, replacing its oldest one
+    void push(std::size_t s, float value) {
+        values_[s * samples_ + heads_[s]] = value;
+        heads_[s] = (heads_[s] + 1) % samples_;
+    }
+
+    // Rewrites the curves and the labels from the current rings
+    void update() {
+        char label[64];
+        for (std::size_t s = 0; s < series_.size(); ++s) {
+            float const* ring = &values_[s * samples_];
+            const float peak = *std::max_element(ring, ring + samples_);
+            const float scale = ceiling(peak);
+            sf::FloatRect const& panel = rects_[s];
+            const float step = panel.width / static_cast<float>(samples_ - 1);
+            auto at = [&](std::size_t k) {
+                const float v = std::min(ring[(heads_[s] + k) % samples_], scale);  // Oldest first
+                return sf::Vector2f(panel.left + step * static_cast<float>(k),
+                                    panel.top + panel.height * (1.f - v / scale));
+            };
+            sf::Vertex* line = &curves_[s * (samples_ - 1) * 2];
+            sf::Vector2f previous = at(0);
+            for (std::size_t k = 1; k < samples_; ++k, line += 2) {
+                const sf::Vector2f next = at(k);
+                line[0].position = previous;
+                line[1].position = next;
+                previous = next;
+            }
+            const float last = ring[(heads_[s] + samples_ - 1) % samples_];
+            std::snprintf(label, sizeof(label), "%s %.2f%s (max %.2f, scale %g)", series_[s].name, last,
+                          series_[s].unit, peak, scale);
+            labels_[s].setString(label);
+        }
+    }
+
+    void draw(sf::RenderTarget& target) const {
+        target.draw(panels_);
+        target.draw(curves_);
+        for (auto const& label : labels_) target.draw(label);
+    }
+
+private:
+    static constexpr float gap = 4.f;
+    static inline const sf::Color background{0, 0, 0, 160};
+
+    // Smallest 1, 2 or 5 times a power of ten at least `value`
+    static float ceiling(float value) {
+        if (!(value > 0.f)) return 1.f;
+        const float power = std::pow(10.f, std::floor(std::log10(value)));
+        for (float m : {1.f, 2.f, 5.f})
+            if (value <= m * power) return m * power;
+        return 10.f * power;
+    }
+
+    std::vector<Series> series_;
+    std::size_t samples_;
+    std::vector<float> values_;  // One ring of samples_ values per series
+    std::vector<std::size_t> heads_;  // Next slot to write, also the oldest value
+    std::vector<sf::FloatRect> rects_;
+    sf::VertexArray panels_;
+    sf::VertexArray curves_;
+    std::vector<sf::Text> labels_;
+};
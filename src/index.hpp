@@ -0,0 +1,37 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include "boid.hpp"
+
+using boid_rtree = bgi::rtree<Boid, bgi::quadratic<32>, Boid::ByPos>;
+
+inline box around(point_2d const& center, float radius) {
+    return {{center.x - radius, center.y - radius}, {center.x + radius, center.y + radius}};
+}
+
+auto intersecting(auto const& search, auto const& tree, float radius) {
+    std::vector<std::reference_wrapper<Boid const>> result;
+    tree.query(bgi::intersects(around(search, radius)) && bgi::satisfies([&](auto const& boid) {
+                   return bg::distance(boid.position, search) < radius;
+               }),
+               std::back_inserter(result));
+    return result;
+}
+
+/**
+ * Same query as intersecting() but appends pointers into a caller-owned
+ * buffer, so the per-boid queries of the simulation do not allocate.
+ */
+template <class Tree>
+void neighbors(Tree const& tree, point_2d const& search, float radius,
+               std::vector<Boid const*>& out) {
+    const float r2 = radius * radius;
+    tree.query(bgi::intersects(around(search, radius)),
+               boost::make_function_output_iterator([&](Boid const& boid) {
+                   if ((boid.position - search).lengthSquared() < r2) out.push_back(&boid);
+               }));
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <algorithm>
+#include <span>
+#include <vector>
+
+#include <boost/geometry/geometries/segment.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include "boid.hpp"
+#include "index.hpp"
+
+using segment = bg::model::segment<point_2d>;
+
+/**
+ * Static geometry the boids steer around. Polygons are stored as their edges
+ * in a separate R-tree that is bulk loaded once (packing algorithm) and never
+ * modified afterwards, so it keeps the tight bulk-loaded node boxes and is not
+ * part of the per-step rebuild of the boid index.
+ */
+class Obstacles {
+public:
+    Obstacles() = default;
+    explicit Obstacles(std::vector<segment> segments)
+        : segments_(std::move(segments)), tree_(segments_.begin(), segments_.end()) {}
+
+    // Edges of the closed polygon through the given vertices
+    static void outline(std::span<point_2d const> vertices, std::vector<segment>& out) {
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+            out.emplace_back(vertices[i], vertices[(i + 1) % vertices.size()]);
+    }
+
+    bool empty() const { return segments_.empty(); }
+    std::vector<segment> const& segments() const { return segments_; }
+
+    /**
+     * Repulsion from every segment closer than `radius`, pointing away from
+     * the closest point and growing linearly from 0 at `radius` to 1 on the
+     * segment itself.
+     */
+    Vec2 avoid(point_2d const& position, float radius) const {
+        Vec2 push;
+        tree_.query(bgi::intersects(around(position, radius)),
+                    boost::make_function_output_iterator([&](segment const& s) {
+                        const Vec2 away = position - closest(s, position);
+                        const float d = away.length();
+                        if (d < radius && d > 0.f) push += away * ((radius - d) / (radius * d));
+                    }));
+        return push;
+    }
+
+    static point_2d closest(segment const& s, point_2d const& p) {
+        const Vec2 ab = s.second - s.first;
+        const float l2 = ab.lengthSquared();
+        if (l2 == 0.f) return s.first;
+        const float t = std::clamp(((p.x - s.first.x) * ab.x + (p.y - s.first.y) * ab.y) / l2, 0.f, 1.f);
+        return s.first + ab * t;
+    }
+
+private:
+    std::vector<segment> segments_;
+    bgi::rtree<segment, bgi::quadratic<16>> tree_;
+};
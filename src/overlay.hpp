@@ -0,0 +1,137 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <boost/geometry/index/detail/rtree/utilities/view.hpp>
+
+#include "grid.hpp"
+#include "index.hpp"
+
+/**
+ * Debug views of the spatial indexes, each generated by a single pass over
+ * the live structure into one vertex array, along with the figures that
+ * tell why queries got slow.
+ *
+ * For the R-tree every node box is outlined in the color of its level, and
+ * each level reports its number of nodes and the sum of their areas over
+ * the area of the root: near 1 the nodes tile the space, well above 1 they
+ * overlap and a query has to descend into several of them.
+ *
+ * For the grid every non-empty cell is filled from green at the mean
+ * occupancy to red at `crowdedRatio` times it, and the fullest cell is
+ * reported: a crowded cell slows down every query of the 9 cells around it.
+ */
+struct NodeLevel {
+    std::size_t nodes = 0;
+    float area = 0.f;  // Sum of the node areas over the area of the root
+};
+
+struct CellOccupancy {
+    std::uint32_t max = 0;
+    float mean = 0.f;  // Over the non-empty cells
+    std::size_t crowded = 0;  // Cells above crowdedRatio times the mean
+};
+
+inline constexpr float crowdedRatio = 4.f;
+
+namespace detail {
+
+inline sf::Color levelColor(std::size_t level) {
+    static const std::array<sf::Color, 6> colors = {sf::Color(255, 255, 255, 200), sf::Color(255, 220, 0, 180),
+                                                    sf::Color(0, 255, 120, 160),   sf::Color(0, 200, 255, 140),
+                                                    sf::Color(255, 0, 255, 120),   sf::Color(255, 120, 0, 100)};
+    return colors[std::min(level, colors.size() - 1)];
+}
+
+// Any Boost.Geometry box, the R-tree nodes use its own point type
+template <class Box>
+void outlineBox(Box const& bounds, sf::Color color, std::vector<sf::Vertex>& lines) {
+    const float left = bg::get<bg::min_corner, 0>(bounds), top = bg::get<bg::min_corner, 1>(bounds);
+    const float right = bg::get<bg::max_corner, 0>(bounds), bottom = bg::get<bg::max_corner, 1>(bounds);
+    const sf::Vector2f corners[] = {{left, top}, {right, top}, {right, bottom}, {left, bottom}};
+    for (int k = 0; k < 4; ++k) {
+        lines.emplace_back(corners[k], color);
+        lines.emplace_back(corners[(k + 1) % 4], color);
+    }
+}
+
+// Depth-first over the internal nodes, outlining the box of every child
+template <class MembersHolder>
+struct NodeOutliner : public MembersHolder::visitor_const {
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+
+    NodeOutliner(std::vector<sf::Vertex>& lines, std::vector<NodeLevel>& levels, float rootArea)
+        : lines(lines), levels(levels), rootArea(rootArea) {}
+
+    void operator()(internal_node const& node) {
+        ++level;
+        if (levels.size() <= level) levels.resize(level + 1);
+        for (auto const& [bounds, child] : bgi::detail::rtree::elements(node)) {
+            outlineBox(bounds, levelColor(level), lines);
+            ++levels[level].nodes;
+            levels[level].area += static_cast<float>(bg::area(bounds)) / rootArea;
+            bgi::detail::rtree::apply_visitor(*this, *child);
+        }
+        --level;
+    }
+
+    void operator()(leaf const&) {}
+
+    std::vector<sf::Vertex>& lines;
+    std::vector<NodeLevel>& levels;
+    float rootArea;
+    std::size_t level = 0;
+};
+
+}  // namespace detail
+
+// Outlines every node of `tree` into `lines` (sf::Lines) and fills `levels`, root first
+inline void outlineNodes(boid_rtree const& tree, std::vector<sf::Vertex>& lines, std::vector<NodeLevel>& levels) {
+    lines.clear();
+    levels.clear();
+    if (tree.empty()) return;
+    const auto root = tree.bounds();
+    const float rootArea = std::max(static_cast<float>(bg::area(root)), 1e-6f);
+    levels.push_back({1, 1.f});
+    detail::outlineBox(root, detail::levelColor(0), lines);
+
+    using View = bgi::detail::rtree::utilities::view<boid_rtree>;
+    View view(tree);
+    detail::NodeOutliner<typename View::members_holder> outliner(lines, levels, rootArea);
+    view.apply_visitor(outliner);
+}
+
+// One quad per non-empty cell of `grid` into `quads` (sf::Quads), colored by occupancy
+inline CellOccupancy fillCells(Grid const& grid, std::vector<sf::Vertex>& quads) {
+    quads.clear();
+    CellOccupancy occupancy;
+    std::size_t occupied = 0, members = 0;
+    for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+        if (grid.count(c) == 0) continue;
+        ++occupied;
+        members += grid.count(c);
+        occupancy.max = std::max(occupancy.max, grid.count(c));
+    }
+    if (occupied == 0) return occupancy;
+    occupancy.mean = static_cast<float>(members) / static_cast<float>(occupied);
+
+    const float size = grid.cellSize();
+    for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+        if (grid.count(c) == 0) continue;
+        const float ratio = static_cast<float>(grid.count(c)) / occupancy.mean;
+        if (ratio >= crowdedRatio) ++occupancy.crowded;
+        const float t = std::clamp((ratio - 1.f) / (crowdedRatio - 1.f), 0.f, 1.f);
+        const sf::Color color(static_cast<std::uint8_t>(255 * t), static_cast<std::uint8_t>(255 * (1.f - t)), 0, 90);
+        const float x = static_cast<float>(static_cast<int>(c) % grid.columns()) * size;
+        const float y = static_cast<float>(static_cast<int>(c) / grid.columns()) * size;
+        quads.emplace_back(sf::Vector2f(x, y), color);
+        quads.emplace_back(sf::Vector2f(x + size, y), color);
+        quads.emplace_back(sf::Vector2f(x + size, y + size), color);
+        quads.emplace_back(sf::Vector2f(x, y + size), color);
+    }
+    return occupancy;
+}
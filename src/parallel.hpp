@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Small persistent thread pool. Work is split into blocks of a fixed grain
+ * that threads claim dynamically; the block partition only depends on the
+ * problem size and the grain, never on the number of threads, so per-block
+ * partial results can be combined in a reproducible order.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, threads);
+        for (unsigned i = 1; i < threads; ++i) workers_.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    static std::size_t blockCount(std::size_t n, std::size_t grain) {
+        return (n + grain - 1) / grain;
+    }
+
+    /**
+     * Calls fn(block, begin, end) for every block of [0, n). The calling
+     * thread takes part in the work and the call returns once every block
+     * has been processed.
+     */
+    template <class F>
+    void parallelFor(std::size_t n, std::size_t grain, F&& fn) {
+        const std::size_t blocks = blockCount(n, grain);
+        auto runBlock = [&](std::size_t b) { fn(b, b * grain, std::min(n, (b + 1) * grain)); };
+        if (workers_.empty() || blocks <= 1) {
+            for (std::size_t b = 0; b < blocks; ++b) runBlock(b);
+            return;
+        }
+
+        std::atomic<std::size_t> next{0};
+        std::function<void()> job = [&] {
+            for (std::size_t b; (b = next.fetch_add(1, std::memory_order_relaxed)) < blocks;)
+                runBlock(b);
+        };
+        {
+            std::lock_guard lock(mutex_);
+            job_ = &job;
+            pending_ = workers_.size();
+            ++generation_;
+        }
+        wake_.notify_all();
+        job();
+
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [&] { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    void work() {
+        std::size_t seen = 0;
+        for (;;) {
+            std::function<void()>* job;
+            {
+                std::unique_lock lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                job = job_;
+            }
+            (*job)();
+            {
+                std::lock_guard lock(mutex_);
+                if (--pending_ == 0) done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::function<void()>* job_ = nullptr;
+    std::size_t pending_ = 0;
+    std::size_t generation_ = 0;
+    bool stop_ = false;
+};
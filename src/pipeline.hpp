@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "flock.hpp"
+
+/**
+ * The simulation side of one frame as an explicit task graph:
+ *
+ *     index -> forces -> integrate -> render prep -> publish
+ *
+ * When pipelined, the render data of frame N is prepared on a worker
+ * thread, started once with the pipeline rather than every frame, while the
+ * index and the forces of frame N+1 are computed: those stages only read
+ * the boids. Integration, the only stage that writes them, waits for the
+ * preparation to finish, and the frame then publishes what was prepared,
+ * one step behind the simulation, for the render thread to draw.
+ *
+ * Each stage records when it started and ended relative to the frame start,
+ * so the overlap can be displayed.
+ */
+class FramePipeline {
+public:
+    enum Stage { Index, Forces, Integrate, RenderPrep, Publish, StageCount };
+
+    struct Span {
+        float start = 0.f;  // ms since the start of the frame
+        float end = 0.f;
+    };
+
+    static constexpr std::array<std::string_view, StageCount> names = {"index", "forces", "integrate",
+                                                                       "render prep", "publish"};
+
+    bool pipelined = true;
+
+    FramePipeline() : worker_([this] { work(); }) {}
+
+    ~FramePipeline() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        posted_.notify_one();
+        worker_.join();
+    }
+
+    FramePipeline(FramePipeline const&) = delete;
+    FramePipeline& operator=(FramePipeline const&) = delete;
+
+    template <class PrepareFn, class PublishFn>
+    void run(Flock& flock, float dt, PrepareFn&& prepare, PublishFn&& publish) {
+        const auto start = clock::now();
+        auto timed = [&](Stage stage, auto&& work) {
+            spans_[stage].start = since(start);
+            work();
+            spans_[stage].end = since(start);
+        };
+
+        if (!pipelined) {
+            timed(Index, [&] { flock.prepare(dt); });
+            timed(Forces, [&] { flock.computeForces(); });
+            timed(Integrate, [&] { flock.integrate(); });
+            timed(RenderPrep, prepare);
+            timed(Publish, publish);
+            return;
+        }
+
+        // The task uses the locals of this call, so it is joined even if the index or the forces throw
+        struct Joined {
+            FramePipeline& pipeline;
+            ~Joined() { pipeline.join(); }
+        } joined{*this};
+        post([&] { timed(RenderPrep, prepare); });
+        timed(Index, [&] { flock.prepare(dt); });
+        timed(Forces, [&] { flock.computeForces(); });
+        if (auto error = join()) std::rethrow_exception(error);
+        timed(Integrate, [&] { flock.integrate(); });
+        timed(Publish, publish);
+    }
+
+    Span const& span(Stage stage) const { return spans_[stage]; }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    static float since(clock::time_point start) {
+        return std::chrono::duration<float, std::milli>(clock::now() - start).count();
+    }
+
+    // Hands `task` to the worker, which runs one task at a time
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex_);
+            task_ = std::move(task);
+        }
+        posted_.notify_one();
+    }
+
+    // Blocks until the posted task is done, if any, and returns what it threw
+    std::exception_ptr join() {
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [&] { return !task_; });
+        return std::exchange(error_, nullptr);
+    }
+
+    void work() {
+        std::unique_lock lock(mutex_);
+        for (;;) {
+            posted_.wait(lock, [&] { return stop_ || task_; });
+            if (stop_) return;
+            lock.unlock();
+            try {
+                task_();
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            lock.lock();
+            task_ = nullptr;
+            done_.notify_one();
+        }
+    }
+
+    std::array<Span, StageCount> spans_;
+    std::mutex mutex_;
+    std::condition_variable posted_;
+    std::condition_variable done_;
+    std::function<void()> task_;  // Set by post(), cleared by the worker once it has run
+    std::exception_ptr error_;
+    bool stop_ = false;
+    std::thread worker_;  // Last, so that it starts once everything else is constructed
+};
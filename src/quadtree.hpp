@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "boid.hpp"
+
+// Number, position sum and velocity sum of a group of boids
+struct Aggregate {
+    std::uint32_t count = 0;
+    Vec2 position;
+    Vec2 velocity;
+
+    void add(Boid const& boid) { add(boid.position, boid.velocity); }
+    void add(point_2d const& p, Vec2 const& v) {
+        ++count;
+        position += p;
+        velocity += v;
+    }
+    Aggregate& operator+=(Aggregate const& other) {
+        count += other.count;
+        position += other.position;
+        velocity += other.velocity;
+        return *this;
+    }
+    Aggregate& operator-=(Boid const& boid) {
+        --count;
+        position -= boid.position;
+        velocity -= boid.velocity;
+        return *this;
+    }
+    Vec2 centerOfMass() const { return position / static_cast<float>(count); }
+    Vec2 meanVelocity() const { return velocity / static_cast<float>(count); }
+};
+
+/**
+ * Barnes-Hut style quadtree: every node stores the aggregate of the boids
+ * below it, so a query over a large radius can take a whole far away node
+ * at once instead of visiting each of its boids.
+ *
+ * Nodes entirely inside the query disc are always taken whole, which is
+ * exact. A node that straddles the disc boundary is opened unless it is
+ * small compared to its distance (size / distance < theta); it is then
+ * counted whole if its center of mass lies in the disc, which is where the
+ * approximation comes from. Nodes containing the query point are always
+ * opened. theta = 0 gives the exact result.
+ */
+class Quadtree {
+public:
+    explicit Quadtree(std::uint32_t leafSize = 8) : leafSize_(leafSize) {}
+
+    void build(std::span<Boid const> boids) {
+        items_.assign(boids.begin(), boids.end());
+        nodes_.clear();
+        if (items_.empty()) return;
+
+        Vec2 lo = items_[0].position, hi = lo;
+        for (auto const& boid : items_) {
+            lo = {std::min(lo.x, boid.position.x), std::min(lo.y, boid.position.y)};
+            hi = {std::max(hi.x, boid.position.x), std::max(hi.y, boid.position.y)};
+        }
+        nodes_.push_back({.min = lo, .size = std::max({hi.x - lo.x, hi.y - lo.y, 1.f}) * 1.0001f});
+        split(0, 0, static_cast<std::uint32_t>(items_.size()), 0);
+    }
+
+    std::size_t nodes() const { return nodes_.size(); }
+
+    /**
+     * Aggregate of the boids within `radius` of `p`. `visited`, if given, is
+     * incremented by the number of nodes and boids looked at.
+     */
+    Aggregate approximate(point_2d const& p, float radius, float theta,
+                          std::size_t* visited = nullptr) const {
+        Aggregate result;
+        if (nodes_.empty()) return result;
+        const float r2 = radius * radius;
+        std::uint32_t stack[4 * maxDepth + 4];
+        std::size_t top = 0, count = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            Node const& node = nodes_[stack[--top]];
+            ++count;
+            const Vec2 hi = node.min + Vec2{node.size, node.size};
+            const float nx = std::max({node.min.x - p.x, 0.f, p.x - hi.x});
+            const float ny = std::max({node.min.y - p.y, 0.f, p.y - hi.y});
+            if (nx * nx + ny * ny >= r2) continue;  // Disjoint
+            const float fx = std::max(std::abs(p.x - node.min.x), std::abs(p.x - hi.x));
+            const float fy = std::max(std::abs(p.y - node.min.y), std::abs(p.y - hi.y));
+            if (fx * fx + fy * fy < r2) {  // Entirely inside
+                result += node.sum;
+                continue;
+            }
+            if (node.child == 0) {
+                for (std::uint32_t i = node.begin; i < node.end; ++i) {
+                    ++count;
+                    if ((items_[i].position - p).lengthSquared() < r2) result.add(items_[i]);
+                }
+                continue;
+            }
+            const float d2 = (node.sum.centerOfMass() - p).lengthSquared();
+            if ((nx > 0.f || ny > 0.f) && node.size * node.size < theta * theta * d2) {
+                if (d2 < r2) result += node.sum;
+                continue;
+            }
+            for (std::uint32_t c = 0; c < 4; ++c)
+                if (nodes_[node.child + c].sum.count > 0) stack[top++] = node.child + c;
+        }
+        if (visited) *visited += count;
+        return result;
+    }
+
+private:
+    static constexpr int maxDepth = 20;
+
+    struct Node {
+        Vec2 min;
+        float size = 0.f;
+        Aggregate sum{};
+        std::uint32_t child = 0;  // First of the four children, 0 for a leaf
+        std::uint32_t begin = 0;
+        std::uint32_t end = 0;
+    };
+
+    void split(std::uint32_t n, std::uint32_t begin, std::uint32_t end, int depth) {
+        nodes_[n].begin = begin;
+        nodes_[n].end = end;
+        for (std::uint32_t i = begin; i < end; ++i) nodes_[n].sum.add(items_[i]);
+        if (end - begin <= leafSize_ || depth == maxDepth) return;
+
+        const float half = nodes_[n].size / 2.f;
+        const Vec2 mid = nodes_[n].min + Vec2{half, half};
+        auto first = items_.begin() + begin, last = items_.begin() + end;
+        auto bottom = std::partition(first, last, [&](Boid const& b) { return b.position.y < mid.y; });
+        auto right0 = std::partition(first, bottom, [&](Boid const& b) { return b.position.x < mid.x; });
+        auto right1 = std::partition(bottom, last, [&](Boid const& b) { return b.position.x < mid.x; });
+
+        const auto child = static_cast<std::uint32_t>(nodes_.size());
+        nodes_[n].child = child;
+        const Vec2 lo = nodes_[n].min;
+        nodes_.push_back({.min = lo, .size = half});
+        nodes_.push_back({.min = {mid.x, lo.y}, .size = half});
+        nodes_.push_back({.min = {lo.x, mid.y}, .size = half});
+        nodes_.push_back({.min = mid, .size = half});
+
+        auto index = [&](auto it) { return static_cast<std::uint32_t>(it - items_.begin()); };
+        split(child, begin, index(right0), depth + 1);
+        split(child + 1, index(right0), index(bottom), depth + 1);
+        split(child + 2, index(bottom), index(right1), depth + 1);
+        split(child + 3, index(right1), end, depth + 1);
+    }
+
+    std::uint32_t leafSize_;
+    std::vector<Node> nodes_;
+    std::vector<Boid> items_;  // Copies of the boids, in tree order
+};
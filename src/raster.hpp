@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "boid.hpp"
+#include "parallel.hpp"
+
+/**
+ * Software splat rasterizer: every boid is a small square dot added into an
+ * RGBA pixel buffer with saturating additive blending, so dense areas get
+ * brighter instead of overdrawing each other, without any GL.
+ *
+ * The image is cut into bands of `tileRows` rows. Dots are first binned by
+ * band with a parallel counting sort (a dot straddling two bands goes into
+ * both), then each band is cleared and splatted by one thread, so no two
+ * threads ever write the same pixel and no atomics are needed.
+ */
+class Rasterizer {
+public:
+    Rasterizer(unsigned width, unsigned height, unsigned tileRows = 32)
+        : width_(width),
+          height_(height),
+          tileRows_(tileRows),
+          tiles_((height + tileRows - 1) / tileRows),
+          pixels_(static_cast<std::size_t>(width) * height * 4) {}
+
+    unsigned width() const { return width_; }
+    unsigned height() const { return height_; }
+    std::uint8_t const* pixels() const { return pixels_.data(); }
+
+    // Draws the boids inside `view`, a world rectangle stretched over the whole image
+    void render(std::span<Boid const> boids, box const& view, bool species, ThreadPool& pool) {
+        const float scale = static_cast<float>(width_) / (view.max_corner().x - view.min_corner().x);
+        const float scaleY = static_cast<float>(height_) / (view.max_corner().y - view.min_corner().y);
+        dot_ = std::clamp(static_cast<int>(std::lround(2.f * scale)), 1, 4);  // Boids are 2 px wide in the world
+
+        // Pass 1: per boid block, count the dots of each band
+        const std::size_t blocks = ThreadPool::blockCount(boids.size(), grain);
+        counts_.assign(blocks * tiles_, 0);
+        splats_.resize(boids.size());
+        pool.parallelFor(boids.size(), grain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            std::uint32_t* counts = &counts_[b * tiles_];
+            for (std::size_t i = begin; i < end; ++i) {
+                const int x = static_cast<int>(std::floor((boids[i].position.x - view.min_corner().x) * scale));
+                const int y = static_cast<int>(std::floor((boids[i].position.y - view.min_corner().y) * scaleY));
+                Splat& splat = splats_[i];
+                splat.visible = x > -dot_ && y > -dot_ && x < static_cast<int>(width_) && y < static_cast<int>(height_);
+                if (!splat.visible) continue;
+                splat.x = static_cast<std::int16_t>(x);
+                splat.y = static_cast<std::int16_t>(y);
+                splat.color = species ? slot(boids[i].species) : 0;
+                forEachTile(y, [&](unsigned t) { ++counts[t]; });
+            }
+        });
+
+        // Offsets in band-major order, blocks in order inside a band
+        start_.assign(tiles_ + 1, 0);
+        std::uint32_t total = 0;
+        for (unsigned t = 0; t < tiles_; ++t) {
+            start_[t] = total;
+            for (std::size_t b = 0; b < blocks; ++b) {
+                const std::uint32_t count = counts_[b * tiles_ + t];
+                counts_[b * tiles_ + t] = total;
+                total += count;
+            }
+        }
+        start_[tiles_] = total;
+
+        // Pass 2: scatter the indices of the dots into their bands
+        binned_.resize(total);
+        pool.parallelFor(boids.size(), grain, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            std::uint32_t* cursor = &counts_[b * tiles_];
+            for (std::size_t i = begin; i < end; ++i)
+                if (splats_[i].visible)
+                    forEachTile(splats_[i].y, [&](unsigned t) { binned_[cursor[t]++] = static_cast<std::uint32_t>(i); });
+        });
+
+        // Pass 3: each band clears and splats its own rows
+        pool.parallelFor(tiles_, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (auto t = static_cast<unsigned>(begin); t < end; ++t) splatTile(t);
+        });
+    }
+
+private:
+    static constexpr std::size_t grain = 16384;
+
+    struct Splat {
+        std::int16_t x;  // Top left pixel of the dot
+        std::int16_t y;
+        std::uint8_t color;
+        bool visible;
+    };
+
+    // Added to the pixels under a dot, per species: prey, predators, neutral
+    static constexpr std::array<std::array<std::uint8_t, 3>, 3> colors = {{{0, 140, 140}, {160, 0, 0}, {90, 90, 90}}};
+
+    static std::uint8_t slot(Species species) { return static_cast<std::uint8_t>(species); }
+
+    // Calls f(band) for the bands covered by the rows [y, y + dot)
+    template <class F>
+    void forEachTile(int y, F&& f) const {
+        const int first = std::max(0, y) / static_cast<int>(tileRows_);
+        const int last = std::min(static_cast<int>(height_) - 1, y + dot_ - 1) / static_cast<int>(tileRows_);
+        for (int t = first; t <= last; ++t) f(static_cast<unsigned>(t));
+    }
+
+    void splatTile(unsigned t) {
+        const int top = static_cast<int>(t * tileRows_);
+        const int bottom = std::min(static_cast<int>(height_), top + static_cast<int>(tileRows_));
+        std::uint8_t* rows = &pixels_[static_cast<std::size_t>(top) * width_ * 4];
+        const std::size_t size = static_cast<std::size_t>(bottom - top) * width_ * 4;
+        for (std::size_t k = 0; k < size; k += 4) {
+            rows[k] = rows[k + 1] = rows[k + 2] = 0;
+            rows[k + 3] = 255;
+        }
+        for (std::uint32_t n = start_[t]; n < start_[t + 1]; ++n) {
+            Splat const& splat = splats_[binned_[n]];
+            auto const& color = colors[splat.color];
+            const int x0 = std::max(0, static_cast<int>(splat.x));
+            const int x1 = std::min(static_cast<int>(width_), splat.x + dot_);
+            const int y0 = std::max(top, static_cast<int>(splat.y));
+            const int y1 = std::min(bottom, splat.y + dot_);
+            for (int y = y0; y < y1; ++y) {
+                std::uint8_t* pixel = &pixels_[(static_cast<std::size_t>(y) * width_ + x0) * 4];
+                for (int x = x0; x < x1; ++x, pixel += 4)
+                    for (int c = 0; c < 3; ++c) pixel[c] = static_cast<std::uint8_t>(std::min(255, pixel[c] + color[c]));
+            }
+        }
+    }
+
+    unsigned width_;
+    unsigned height_;
+    unsigned tileRows_;
+    unsigned tiles_;
+    int dot_ = 2;
+    std::vector<std::uint8_t> pixels_;
+    std::vector<Splat> splats_;
+    std::vector<std::uint32_t> counts_;  // Per block and band, then the write cursors of pass 2
+    std::vector<std::uint32_t> start_;   // First binned dot of each band
+    std::vector<std::uint32_t> binned_;  // Boid indices grouped by band
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Writes captured frames as a numbered image sequence on a background
+ * thread. The queue between the capturing thread and the writer is
+ * bounded: when the disk cannot keep up, new frames are dropped and
+ * counted instead of stalling the caller. Frame buffers are recycled, so
+ * recording does not allocate once the queue has been filled once. Only the
+ * accepted frames are numbered, so the sequence has no gap where some were
+ * dropped.
+ */
+class Recorder {
+public:
+    struct Frame {
+        unsigned width = 0;
+        unsigned height = 0;
+        std::vector<std::uint8_t> pixels;  // RGBA
+        std::uint64_t index = 0;
+    };
+
+    // Writes one frame to `path`, returns false on failure
+    using Writer = std::function<bool(Frame const&, std::string const& path)>;
+
+    // Frames are numbered from `first`, so that a new recording can carry on the sequence of the previous one
+    explicit Recorder(std::string prefix, std::size_t capacity = 8, std::string extension = "ppm",
+                      Writer writer = writePpm, std::uint64_t first = 0)
+        : prefix_(std::move(prefix)),
+          extension_(std::move(extension)),
+          capacity_(capacity),
+          writer_(std::move(writer)),
+          accepted_(first),
+          thread_([this] { work(); }) {}
+
+    // Writes what is still queued, then stops
+    ~Recorder() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_one();
+        thread_.join();
+    }
+
+    Recorder(Recorder const&) = delete;
+    Recorder& operator=(Recorder const&) = delete;
+
+    // Copies the frame into the queue; returns false and counts a drop if it is full
+    bool push(unsigned width, unsigned height, std::uint8_t const* rgba) {
+        Frame frame;
+        {
+            std::lock_guard lock(mutex_);
+            ++captured_;
+            if (queue_.size() + copying_ >= capacity_) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (!free_.empty()) {
+                frame = std::move(free_.back());
+                free_.pop_back();
+            }
+            frame.index = accepted_++;
+            ++copying_;
+        }
+        frame.width = width;
+        frame.height = height;
+        frame.pixels.assign(rgba, rgba + static_cast<std::size_t>(width) * height * 4);
+        {
+            std::lock_guard lock(mutex_);
+            --copying_;
+            queue_.push_back(std::move(frame));
+        }
+        ready_.notify_one();
+        return true;
+    }
+
+    // Blocks until every accepted frame has been written or has failed
+    void flush() {
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [&] { return queue_.empty() && copying_ == 0 && !writing_; });
+    }
+
+    // Number of the next accepted frame
+    std::uint64_t next() const {
+        std::lock_guard lock(mutex_);
+        return accepted_;
+    }
+
+    std::uint64_t captured() const {
+        std::lock_guard lock(mutex_);
+        return captured_;
+    }
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    std::uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    std::uint64_t failed() const { return failed_.load(std::memory_order_relaxed); }
+
+    // Binary PPM (P6), the alpha channel is dropped
+    static bool writePpm(Frame const& frame, std::string const& path) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        std::fprintf(file, "P6\n%u %u\n255\n", frame.width, frame.height);
+        std::vector<std::uint8_t> row(static_cast<std::size_t>(frame.width) * 3);
+        bool ok = true;
+        for (unsigned y = 0; y < frame.height && ok; ++y) {
+            std::uint8_t const* pixel = &frame.pixels[static_cast<std::size_t>(y) * frame.width * 4];
+            for (unsigned x = 0; x < frame.width; ++x, pixel += 4) {
+                row[x * 3] = pixel[0];
+                row[x * 3 + 1] = pixel[1];
+                row[x * 3 + 2] = pixel[2];
+            }
+            ok = std::fwrite(row.data(), 1, row.size(), file) == row.size();
+        }
+        return std::fclose(file) == 0 && ok;
+    }
+
+private:
+    void work() {
+        for (;;) {
+            Frame frame;
+            {
+                std::unique_lock lock(mutex_);
+                ready_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) return;  // Stopped and flushed
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+                writing_ = true;
+            }
+            char number[24];
+            std::snprintf(number, sizeof(number), "%06llu.", static_cast<unsigned long long>(frame.index));
+            if (writer_(frame, prefix_ + number + extension_))
+                written_.fetch_add(1, std::memory_order_relaxed);
+            else
+                failed_.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard lock(mutex_);
+                free_.push_back(std::move(frame));
+                writing_ = false;
+            }
+            idle_.notify_all();
+        }
+    }
+
+    std::string prefix_;
+    std::string extension_;
+    std::size_t capacity_;
+    Writer writer_;
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable idle_;  // Signaled after each frame is written
+    std::deque<Frame> queue_;
+    std::vector<Frame> free_;
+    std::size_t copying_ = 0;  // Frames reserved by push() and being copied
+    bool writing_ = false;  // The writer holds a frame taken off the queue
+    std::uint64_t captured_ = 0;
+    std::uint64_t accepted_;  // Number of the next accepted frame
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> written_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    bool stop_ = false;
+    std::thread thread_;  // Last, so that it starts once everything else is constructed
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "boid.hpp"
+
+inline sf::Color colorOf(Species species) {
+    switch (species) {
+        case Species::Predator: return sf::Color::Red;
+        case Species::Neutral: return sf::Color(180, 180, 180);
+        default: return sf::Color::Cyan;
+    }
+}
+
+/**
+ * Draws every boid as a small glyph of one vertex array, so the whole
+ * flock is a single draw call. The vertices are filled in one pass over the
+ * contiguous boid storage, during the render prep stage, and only drawn in
+ * the draw stage.
+ *
+ * Glyphs are either axis-aligned quads or triangles pointing along the
+ * velocity. The triangle corners are computed first over plain float
+ * arrays, one per coordinate: the heading is the normalized velocity, which
+ * is directly the cosine and sine of the rotation, so there is no
+ * trigonometry and no branch and the loop vectorizes (sqrt needs
+ * -fno-math-errno for that). Only then are they copied into the vertices.
+ *
+ * In immediate mode the whole array is sent with the draw call every frame.
+ * In buffered mode it lives in a streaming sf::VertexBuffer on the GPU side
+ * and only the ranges of boids whose quad changed since the previous frame
+ * are uploaded, which saves most of the copy when boids sleep or are
+ * updated at a lower rate off-screen.
+ */
+class BoidRenderer {
+public:
+    enum class Mode { Immediate, Buffered };
+    enum class Glyph { Quad, Triangle };
+
+    // Quads are `size` wide, triangles 3 `size` long and 2 `size` wide
+    explicit BoidRenderer(float size = 2.f) : size_(size), buffer_(sf::Triangles, sf::VertexBuffer::Stream) {}
+
+    Mode mode() const { return mode_; }
+    void setMode(Mode mode) {
+        if (mode == Mode::Buffered && !sf::VertexBuffer::isAvailable()) return;
+        mode_ = mode;
+        full_ = true;
+    }
+
+    Glyph glyph() const { return glyph_; }
+    void setGlyph(Glyph glyph) {
+        glyph_ = glyph;
+        vertices_.clear();  // Every glyph is rewritten by the next prepare()
+        buffer_.setPrimitiveType(primitive());
+        full_ = true;
+        stale_ = true;
+    }
+
+    // The vertices do not match the glyph any more, prepare() must run before the next draw
+    bool stale() const { return stale_; }
+
+    // Forces the next prepare() and a whole upload, after frames where prepare() was skipped
+    void invalidate() {
+        full_ = true;
+        stale_ = true;
+    }
+
+    void prepare(std::span<Boid const> boids, bool species) {
+        const std::size_t n = glyph_ == Glyph::Triangle ? 3 : 4;
+        if (glyph_ == Glyph::Triangle) orient(boids);
+        // Glyphs past the previous count are new, the others are compared with what the buffer already holds
+        const std::size_t kept = std::min(vertices_.size() / n, boids.size());
+        stale_ = false;
+        vertices_.resize(boids.size() * n);
+        dirty_.clear();
+        for (std::size_t i = 0; i < boids.size(); ++i) {
+            const float x = boids[i].position.x, y = boids[i].position.y;
+            const sf::Color color = species ? colorOf(boids[i].species) : sf::Color::Cyan;
+            std::array<sf::Vector2f, 4> corners;
+            if (glyph_ == Glyph::Triangle)
+                for (std::size_t k = 0; k < 3; ++k) corners[k] = {cornerX_[k][i], cornerY_[k][i]};
+            else
+                corners = {{{x, y}, {x + size_, y}, {x + size_, y + size_}, {x, y + size_}}};
+            sf::Vertex* glyph = &vertices_[i * n];
+            if (i < kept && glyph[0].color == color &&
+                std::equal(corners.begin(), corners.begin() + n, glyph,
+                           [](sf::Vector2f corner, sf::Vertex const& vertex) { return corner == vertex.position; }))
+                continue;
+            for (std::size_t k = 0; k < n; ++k) glyph[k] = {corners[k], color};
+            // Runs closer than `gap` are merged, one larger upload being cheaper than many small ones
+            if (!dirty_.empty() && i - dirty_.back().second <= gap)
+                dirty_.back().second = i + 1;
+            else
+                dirty_.push_back({i, i + 1});
+        }
+    }
+
+    // Farthest a glyph reaches from its boid position
+    static float reach(float size = 2.f) { return 2.f * size; }
+
+    // Returns the number of draw calls issued
+    unsigned draw(sf::RenderTarget& target) {
+        if (mode_ == Mode::Immediate) {
+            uploaded_ = vertices_.size();
+            target.draw(vertices_.data(), vertices_.size(), primitive());
+            return 1;
+        }
+        uploaded_ = 0;
+        // The count follows the culling every frame, so the buffer only grows, geometrically, and the unused
+        // tail is not drawn
+        if (buffer_.getVertexCount() < vertices_.size()) {
+            buffer_.create(std::max(vertices_.size(), buffer_.getVertexCount() * 3 / 2));
+            full_ = true;
+        }
+        const std::size_t n = glyph_ == Glyph::Triangle ? 3 : 4;
+        if (full_) dirty_.assign(1, {0, vertices_.size() / n});
+        full_ = false;
+        for (auto [begin, end] : dirty_) {
+            buffer_.update(vertices_.data() + begin * n, (end - begin) * n, static_cast<unsigned>(begin * n));
+            uploaded_ += (end - begin) * n;
+        }
+        dirty_.clear();
+        target.draw(buffer_, 0, vertices_.size());
+        return 1;
+    }
+
+    // Vertices sent to the GPU by the last draw
+    std::size_t uploaded() const { return uploaded_; }
+
+private:
+    static constexpr std::size_t gap = 64;
+
+    sf::PrimitiveType primitive() const { return glyph_ == Glyph::Triangle ? sf::Triangles : sf::Quads; }
+
+    // Tip, left and right corners of every triangle, rotated by the heading of its boid
+    void orient(std::span<Boid const> boids) {
+        const std::size_t count = boids.size();
+        for (auto* column : {&x_, &y_, &vx_, &vy_}) column->resize(count);
+        for (std::size_t k = 0; k < 3; ++k) {
+            cornerX_[k].resize(count);
+            cornerY_[k].resize(count);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            x_[i] = boids[i].position.x;
+            y_[i] = boids[i].position.y;
+            vx_[i] = boids[i].velocity.x;
+            vy_[i] = boids[i].velocity.y;
+        }
+        rotate(count, size_, x_.data(), y_.data(), vx_.data(), vy_.data(), cornerX_[0].data(), cornerY_[0].data(),
+               cornerX_[1].data(), cornerY_[1].data(), cornerX_[2].data(), cornerY_[2].data());
+    }
+
+    /**
+     * The local triangle has its tip at (2 size, 0) and its base at x = -size
+     * from y = -size to y = size. The arrays are declared not to overlap:
+     * otherwise the compiler checks every pair at run time and gives up.
+     */
+    static void rotate(std::size_t count, float size, float const* __restrict x, float const* __restrict y,
+                       float const* __restrict vx, float const* __restrict vy, float* __restrict tipX,
+                       float* __restrict tipY, float* __restrict leftX, float* __restrict leftY,
+                       float* __restrict rightX, float* __restrict rightY) {
+        const float front = 2.f * size, back = size, half = size;
+        for (std::size_t i = 0; i < count; ++i) {
+            // The tiny bias makes a boid at rest point right without a branch
+            const float hx = vx[i] + 1e-6f;
+            const float inverse = 1.f / std::sqrt(hx * hx + vy[i] * vy[i]);
+            const float cos = hx * inverse;
+            const float sin = vy[i] * inverse;
+            tipX[i] = x[i] + cos * front;
+            tipY[i] = y[i] + sin * front;
+            leftX[i] = x[i] - cos * back + sin * half;
+            leftY[i] = y[i] - sin * back - cos * half;
+            rightX[i] = x[i] - cos * back - sin * half;
+            rightY[i] = y[i] - sin * back + cos * half;
+        }
+    }
+
+    float size_;
+    Mode mode_ = Mode::Immediate;
+    Glyph glyph_ = Glyph::Triangle;
+    bool stale_ = false;
+    std::vector<sf::Vertex> vertices_;
+    std::vector<std::pair<std::size_t, std::size_t>> dirty_;  // Boid ranges changed since the last upload
+    sf::VertexBuffer buffer_;
+    bool full_ = true;  // The buffer must be uploaded whole
+    std::size_t uploaded_ = 0;
+    std::vector<float> x_, y_, vx_, vy_;  // Boids copied one array per coordinate
+    std::array<std::vector<float>, 3> cornerX_, cornerY_;
+};
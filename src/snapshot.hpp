@@ -0,0 +1,48 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free triple buffer between one writer and one reader. The writer
+ * fills back() and publishes it, the reader acquires the most recently
+ * published buffer and reads front(). Neither side ever waits for the
+ * other: the writer swaps its buffer with the middle one, and a buffer
+ * published while the previous one was not acquired yet replaces it, which
+ * counts as a dropped snapshot.
+ *
+ * Buffers are reused round-robin, so a T holding vectors stops allocating
+ * once they reached their size.
+ */
+template <class T>
+class TripleBuffer {
+public:
+    T& back() { return buffers_[back_]; }
+    T const& front() const { return buffers_[front_]; }
+
+    void publish() {
+        const auto previous = middle_.exchange(back_ | fresh, std::memory_order_acq_rel);
+        if (previous & fresh) dropped_.fetch_add(1, std::memory_order_relaxed);
+        back_ = previous & slot;
+    }
+
+    // Returns false, keeping the current front, if nothing new was published
+    bool acquire() {
+        if (!(middle_.load(std::memory_order_relaxed) & fresh)) return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & slot;
+        return true;
+    }
+
+    // Snapshots published but replaced before the reader got them
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr std::uint8_t slot = 3;
+    static constexpr std::uint8_t fresh = 4;
+
+    std::array<T, 3> buffers_;
+    std::uint8_t back_ = 0;   // Only touched by the writer
+    std::uint8_t front_ = 1;  // Only touched by the reader
+    std::atomic<std::uint8_t> middle_{2};
+    std::atomic<std::uint64_t> dropped_{0};
+};
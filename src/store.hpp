@@ -0,0 +1,341 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "boid.hpp"
+#include "grid.hpp"
+
+/**
+ * Cell-sorted copies of the boid state read by the grid force kernel, so
+ * that the 3x3 block of cells around a boid is a few contiguous runs of
+ * memory. All stores have the same interface and the kernel is written
+ * once for any of them: `operator[]` returns whatever handle `position()`
+ * and `velocity()` need to decode a boid.
+ *
+ * The `lanewise` stores, which hold each coordinate in runs of 8 values,
+ * also provide `stage()` and `gather()`: the kernel stages the 3x3 block
+ * around a cell before its members, then hands them whole cells and they
+ * go through the candidates 8 at a time (see LaneSums) instead of one by
+ * one.
+ */
+
+struct PackedBoid {
+    point_2d position;
+    Vec2 velocity;
+};
+
+/**
+ * Neighbor terms summed over groups of 8 candidates, one partial sum per
+ * lane. A group is read in one go from 8 consecutive floats per coordinate,
+ * and the lanes outside the cell range or too far away are masked out
+ * rather than skipped, so that the loop has no branch and no dependency
+ * between lanes and the compiler turns it into SIMD operations.
+ */
+struct LaneSums {
+    static constexpr std::uint32_t lanes = 8;
+
+    float count[lanes] = {};
+    float x[lanes] = {};
+    float y[lanes] = {};
+    float vx[lanes] = {};
+    float vy[lanes] = {};
+    float separationX[lanes] = {};
+    float separationY[lanes] = {};
+
+    /**
+     * Adds the lane group of slots [first, first + 8) read from `gx`, `gy`,
+     * `gvx` and `gvy`, keeping the slots in [begin, end) other than `self`
+     * that lie within sqrt(r2) of `center`. Those within sqrt(separation2)
+     * at a non-zero distance also add to the separation.
+     */
+    void add(float const* __restrict gx, float const* __restrict gy, float const* __restrict gvx,
+             float const* __restrict gvy, std::uint32_t first, std::uint32_t begin, std::uint32_t end,
+             std::uint32_t self, point_2d center, float r2, float separation2) {
+        for (std::uint32_t l = 0; l < lanes; ++l) {
+            // Masks multiply rather than select, which the compiler would turn back into branches. Lanes out
+            // of range hold other boids or padding, finite either way, so they still add zero
+            const std::uint32_t slot = first + l;
+            const float dx = center.x - gx[l];
+            const float dy = center.y - gy[l];
+            const float d2 = dx * dx + dy * dy;
+            const float in = static_cast<float>((slot >= begin) & (slot < end) & (slot != self) & (d2 < r2));
+            const float near = static_cast<float>((d2 < separation2) & (d2 > 0.f)) * in;
+            const float weight = near / std::max(d2, 1e-30f);
+            count[l] += in;
+            x[l] += in * gx[l];
+            y[l] += in * gy[l];
+            vx[l] += in * gvx[l];
+            vy[l] += in * gvy[l];
+            separationX[l] += weight * dx;
+            separationY[l] += weight * dy;
+        }
+    }
+};
+
+// Plain float copy, 16 bytes per boid
+class FloatStore {
+public:
+    static constexpr bool lanewise = false;
+
+    void build(Grid const& grid, std::span<Boid const> boids, float) {
+        records_.resize(boids.size());
+        for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+            std::uint32_t slot = grid.begin(c);
+            for (auto i : grid.members(c)) records_[slot++] = {boids[i].position, boids[i].velocity};
+        }
+    }
+
+    std::size_t bytes() const { return records_.size() * sizeof(PackedBoid); }
+    PackedBoid const& operator[](std::uint32_t slot) const { return records_[slot]; }
+
+    Vec2 origin(std::uint32_t) const { return {}; }
+    point_2d position(PackedBoid const& p, Vec2 const&) const { return p.position; }
+    Vec2 velocity(PackedBoid const& p) const { return p.velocity; }
+
+private:
+    std::vector<PackedBoid> records_;
+};
+
+// One array per coordinate, the handle is the slot itself
+class SoaStore {
+public:
+    static constexpr bool lanewise = true;
+
+    void build(Grid const& grid, std::span<Boid const> boids, float) {
+        // Padded to whole lane groups, which gather() reads past the last boid
+        const std::size_t padded = (boids.size() + LaneSums::lanes - 1) / LaneSums::lanes * LaneSums::lanes;
+        x_.resize(padded);
+        y_.resize(padded);
+        vx_.resize(padded);
+        vy_.resize(padded);
+        for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+            std::uint32_t slot = grid.begin(c);
+            for (auto i : grid.members(c)) {
+                x_[slot] = boids[i].position.x;
+                y_[slot] = boids[i].position.y;
+                vx_[slot] = boids[i].velocity.x;
+                vy_[slot++] = boids[i].velocity.y;
+            }
+        }
+    }
+
+    std::size_t bytes() const { return x_.size() * 4 * sizeof(float); }
+    std::uint32_t operator[](std::uint32_t slot) const { return slot; }
+
+    Vec2 origin(std::uint32_t) const { return {}; }
+    point_2d position(std::uint32_t slot, Vec2 const&) const { return {x_[slot], y_[slot]}; }
+    Vec2 velocity(std::uint32_t slot) const { return {vx_[slot], vy_[slot]}; }
+
+    void stage(Grid const&, std::uint32_t) const {}
+
+    // Adds slots [begin, end) to `sums`, by lane groups aligned on multiples of 8
+    void gather(std::uint32_t, std::uint32_t begin, std::uint32_t end, std::uint32_t self, point_2d center,
+                float r2, float separation2, LaneSums& sums) const {
+        for (std::uint32_t first = begin / LaneSums::lanes * LaneSums::lanes; first < end; first += LaneSums::lanes)
+            sums.add(&x_[first], &y_[first], &vx_[first], &vy_[first], first, begin, end, self, center, r2,
+                     separation2);
+    }
+
+private:
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> vx_;
+    std::vector<float> vy_;
+};
+
+/**
+ * Blocks of 8 consecutive boids, each coordinate stored as 8 contiguous
+ * floats: the positions of a block fill exactly one 64-byte cache line and
+ * its velocities the next one, and each coordinate is one 256-bit SIMD
+ * lane group.
+ */
+struct alignas(64) BoidBlock {
+    static constexpr std::uint32_t lanes = LaneSums::lanes;
+    float x[lanes];
+    float y[lanes];
+    float vx[lanes];
+    float vy[lanes];
+};
+
+class AosoaStore {
+public:
+    static constexpr bool lanewise = true;
+
+    void build(Grid const& grid, std::span<Boid const> boids, float) {
+        blocks_.resize((boids.size() + BoidBlock::lanes - 1) / BoidBlock::lanes);
+        for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+            std::uint32_t slot = grid.begin(c);
+            for (auto i : grid.members(c)) {
+                auto& block = blocks_[slot / BoidBlock::lanes];
+                const std::uint32_t lane = slot++ % BoidBlock::lanes;
+                block.x[lane] = boids[i].position.x;
+                block.y[lane] = boids[i].position.y;
+                block.vx[lane] = boids[i].velocity.x;
+                block.vy[lane] = boids[i].velocity.y;
+            }
+        }
+    }
+
+    std::size_t bytes() const { return blocks_.size() * sizeof(BoidBlock); }
+    std::uint32_t operator[](std::uint32_t slot) const { return slot; }
+
+    Vec2 origin(std::uint32_t) const { return {}; }
+    point_2d position(std::uint32_t slot, Vec2 const&) const {
+        auto const& block = blocks_[slot / BoidBlock::lanes];
+        return {block.x[slot % BoidBlock::lanes], block.y[slot % BoidBlock::lanes]};
+    }
+    Vec2 velocity(std::uint32_t slot) const {
+        auto const& block = blocks_[slot / BoidBlock::lanes];
+        return {block.vx[slot % BoidBlock::lanes], block.vy[slot % BoidBlock::lanes]};
+    }
+
+    void stage(Grid const&, std::uint32_t) const {}
+
+    // Adds slots [begin, end) to `sums`, one block at a time
+    void gather(std::uint32_t, std::uint32_t begin, std::uint32_t end, std::uint32_t self, point_2d center,
+                float r2, float separation2, LaneSums& sums) const {
+        for (std::uint32_t b = begin / BoidBlock::lanes; b * BoidBlock::lanes < end; ++b) {
+            auto const& block = blocks_[b];
+            sums.add(block.x, block.y, block.vx, block.vy, b * BoidBlock::lanes, begin, end, self, center, r2,
+                     separation2);
+        }
+    }
+
+private:
+    std::vector<BoidBlock> blocks_;
+};
+
+/**
+ * Compact copy of the boids, 8 bytes per boid instead of 16. Positions are
+ * stored as 16-bit fixed-point offsets relative to their cell, whose origin
+ * is implied by the position in the array, and velocities as 16-bit
+ * fractions of the maximum speed. With 50 px cells the position step is
+ * under 0.001 px.
+ *
+ * Like SoaStore it holds one array per coordinate. stage() decodes the
+ * lane groups of a 3x3 block into floats once, in a scratch buffer per
+ * thread, and gather() reads them 8 at a time for every member of the
+ * center cell. build() still reads the float state of every boid once per
+ * step; what is halved is the traffic of the kernel, which reads every
+ * boid once for each of the 9 cells around it.
+ */
+class QuantizedStore {
+public:
+    static constexpr bool lanewise = true;
+
+    void build(Grid const& grid, std::span<Boid const> boids, float maxSpeed) {
+        cell_ = grid.cellSize();
+        columns_ = grid.columns();
+        speed_ = maxSpeed;
+        positionStep_ = cell_ / 65535.f;
+        velocityStep_ = speed_ / 32767.f;
+        // Padded to whole lane groups, which gather() reads past the last boid
+        const std::size_t padded = (boids.size() + LaneSums::lanes - 1) / LaneSums::lanes * LaneSums::lanes;
+        x_.resize(padded);
+        y_.resize(padded);
+        vx_.resize(padded);
+        vy_.resize(padded);
+        for (std::uint32_t c = 0; c < grid.cells(); ++c) {
+            const Vec2 origin = this->origin(c);
+            std::uint32_t slot = grid.begin(c);
+            for (auto i : grid.members(c)) {
+                x_[slot] = offset(boids[i].position.x - origin.x);
+                y_[slot] = offset(boids[i].position.y - origin.y);
+                vx_[slot] = speed(boids[i].velocity.x);
+                vy_[slot++] = speed(boids[i].velocity.y);
+            }
+        }
+    }
+
+    std::size_t bytes() const { return x_.size() * 4 * sizeof(std::uint16_t); }
+    std::uint32_t operator[](std::uint32_t slot) const { return slot; }
+
+    Vec2 origin(std::uint32_t cell) const {
+        return {static_cast<float>(static_cast<int>(cell) % columns_) * cell_,
+                static_cast<float>(static_cast<int>(cell) / columns_) * cell_};
+    }
+    point_2d position(std::uint32_t slot, Vec2 const& origin) const {
+        return {origin.x + x_[slot] * positionStep_, origin.y + y_[slot] * positionStep_};
+    }
+    Vec2 velocity(std::uint32_t slot) const { return {vx_[slot] * velocityStep_, vy_[slot] * velocityStep_}; }
+
+    // Decodes the 3x3 block around `cell`, lane groups aligned on multiples of 8, into this thread's scratch
+    void stage(Grid const& grid, std::uint32_t cell) const {
+        Staged& staged = scratch();
+        std::uint32_t used = 0;
+        staged.count = 0;
+        grid.forEachAdjacent(cell, [&](std::uint32_t n) {
+            const std::uint32_t first = grid.begin(n) / LaneSums::lanes * LaneSums::lanes;
+            const std::uint32_t last = (grid.begin(n) + grid.count(n) + LaneSums::lanes - 1) / LaneSums::lanes *
+                                       LaneSums::lanes;
+            staged.cells[staged.count] = n;
+            staged.shift[staged.count++] = used - first;
+            if (staged.x.size() < used + (last - first)) {
+                staged.x.resize(used + (last - first));
+                staged.y.resize(used + (last - first));
+                staged.vx.resize(used + (last - first));
+                staged.vy.resize(used + (last - first));
+            }
+            // Lanes of the neighboring cells are decoded with this origin too, gather() masks them out
+            const Vec2 origin = this->origin(n);
+            for (std::uint32_t s = first; s < last; ++s, ++used) {
+                staged.x[used] = origin.x + static_cast<float>(x_[s]) * positionStep_;
+                staged.y[used] = origin.y + static_cast<float>(y_[s]) * positionStep_;
+                staged.vx[used] = static_cast<float>(vx_[s]) * velocityStep_;
+                staged.vy[used] = static_cast<float>(vy_[s]) * velocityStep_;
+            }
+        });
+    }
+
+    // Adds slots [begin, end) of `cell`, staged with the block around the current cell, to `sums`
+    void gather(std::uint32_t cell, std::uint32_t begin, std::uint32_t end, std::uint32_t self, point_2d center,
+                float r2, float separation2, LaneSums& sums) const {
+        Staged const& staged = scratch();
+        std::uint32_t k = 0;
+        while (staged.cells[k] != cell) ++k;
+        for (std::uint32_t first = begin / LaneSums::lanes * LaneSums::lanes; first < end;
+             first += LaneSums::lanes) {
+            const std::uint32_t at = first + staged.shift[k];
+            sums.add(&staged.x[at], &staged.y[at], &staged.vx[at], &staged.vy[at], first, begin, end, self, center,
+                     r2, separation2);
+        }
+    }
+
+private:
+    // Decoded floats of the cells of one 3x3 block, one after the other
+    struct Staged {
+        std::array<std::uint32_t, 9> cells;
+        std::array<std::uint32_t, 9> shift;  // Scratch index minus store slot, wrapping for the first cells
+        std::uint32_t count = 0;
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> vx;
+        std::vector<float> vy;
+    };
+
+    static Staged& scratch() {
+        thread_local Staged staged;
+        return staged;
+    }
+
+    std::uint16_t offset(float v) const {
+        return static_cast<std::uint16_t>(std::clamp(std::lround(v / cell_ * 65535.f), 0l, 65535l));
+    }
+    std::int16_t speed(float v) const {
+        return static_cast<std::int16_t>(std::clamp(std::lround(v / speed_ * 32767.f), -32767l, 32767l));
+    }
+
+    float cell_ = 1.f;
+    int columns_ = 1;
+    float speed_ = 1.f;
+    float positionStep_ = 1.f;
+    float velocityStep_ = 1.f;
+    std::vector<std::uint16_t> x_;  // Offset inside the grid cell, in 1/65535 of the cell size
+    std::vector<std::uint16_t> y_;
+    std::vector<std::int16_t> vx_;  // Velocity, in 1/32767 of the maximum speed
+    std::vector<std::int16_t> vy_;
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "boid.hpp"
+#include "parallel.hpp"
+#include "render.hpp"
+
+/**
+ * Motion trails: the last `length` positions of every boid, drawn as
+ * fading line segments.
+ *
+ * The history is one ring per boid, indexed by ID, stored as two float
+ * arrays (x and y) of `length` consecutive samples per boid, and a single
+ * head shared by all rings since every recorded boid gets a sample at the
+ * same time. A boid that was not recorded the previous time, because it was
+ * off-screen, has its ring filled with its current position instead of
+ * being joined to a stale one.
+ *
+ * SFML has no primitive restart, so one line strip cannot hold many trails:
+ * the segments go into a single sf::Lines array instead, at fixed offsets
+ * per boid so that blocks of boids are filled in parallel. Segments jumping
+ * further than `maxJump`, where the world wraps around, are left
+ * transparent. Every array only grows, when the number of boids does, so
+ * nothing is allocated from one frame to the next.
+ */
+class Trails {
+public:
+    explicit Trails(unsigned length = 16, float maxJump = 100.f)
+        : length_(std::max(length, 2u)), maxJump_(maxJump), fade_(length_ - 1), order_(length_) {
+        for (unsigned k = 0; k + 1 < length_; ++k)
+            fade_[k] = static_cast<std::uint8_t>(200 * (k + 1) / (length_ - 1));  // Oldest segment first
+    }
+
+    // Appends the current positions of `boids`, out of `total` boids with IDs below total
+    void record(std::span<Boid const> boids, std::size_t total) {
+        if (seen_.size() != total) {
+            x_.assign(total * length_, 0.f);
+            y_.assign(total * length_, 0.f);
+            seen_.assign(total, 0);
+            frame_ = 1;  // So that no boid counts as recorded the previous time
+        }
+        ++frame_;
+        head_ = (head_ + 1) % length_;
+        for (Boid const& boid : boids) {
+            float* x = &x_[static_cast<std::size_t>(boid.id) * length_];
+            float* y = &y_[static_cast<std::size_t>(boid.id) * length_];
+            if (seen_[boid.id] + 1 != frame_) {
+                std::fill(x, x + length_, boid.position.x);
+                std::fill(y, y + length_, boid.position.y);
+            }
+            x[head_] = boid.position.x;
+            y[head_] = boid.position.y;
+            seen_[boid.id] = frame_;
+        }
+    }
+
+    // Rebuilds the segments of `boids`, which must have just been recorded
+    void prepare(std::span<Boid const> boids, bool species, ThreadPool& pool) {
+        const std::size_t segments = length_ - 1;
+        vertices_.resize(boids.size() * segments * 2);
+        for (unsigned k = 0; k < length_; ++k) order_[k] = (head_ + 1 + k) % length_;  // Oldest sample first
+        // Fields are assigned one by one: the sf::Vertex and sf::Color constructors are not inline in SFML 2
+        pool.parallelFor(boids.size(), grain, [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                sf::Color color = species ? colorOf(boids[i].species) : sf::Color::Cyan;
+                float const* x = &x_[static_cast<std::size_t>(boids[i].id) * length_];
+                float const* y = &y_[static_cast<std::size_t>(boids[i].id) * length_];
+                sf::Vertex* line = &vertices_[i * segments * 2];
+                for (std::size_t k = 0; k < segments; ++k, line += 2) {
+                    const unsigned from = order_[k], to = order_[k + 1];
+                    const bool wrapped =
+                        std::abs(x[to] - x[from]) > maxJump_ || std::abs(y[to] - y[from]) > maxJump_;
+                    color.a = wrapped ? 0 : fade_[k];
+                    line[0].position.x = x[from];
+                    line[0].position.y = y[from];
+                    line[0].color = color;
+                    line[1].position.x = x[to];
+                    line[1].position.y = y[to];
+                    line[1].color = color;
+                }
+            }
+        });
+    }
+
+    void draw(sf::RenderTarget& target) const { target.draw(vertices_.data(), vertices_.size(), sf::Lines); }
+
+private:
+    static constexpr std::size_t grain = 1024;
+
+    unsigned length_;
+    float maxJump_;
+    std::vector<std::uint8_t> fade_;  // Alpha of each segment, by age
+    std::vector<unsigned> order_;  // Ring slots from the oldest sample to the latest
+    std::vector<float> x_;  // length_ samples per boid, in ID order
+    std::vector<float> y_;
+    std::vector<std::uint32_t> seen_;  // Frame of the last sample of each boid
+    std::uint32_t frame_ = 0;
+    unsigned head_ = 0;  // Slot of the latest sample in every ring
+    std::vector<sf::Vertex> vertices_;
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "boid.hpp"
+
+/**
+ * Small and fast seeded PRNG (xoshiro128+, seeded through splitmix64). It is
+ * only meant for generating scenes, where speed and reproducibility matter
+ * more than statistical quality. The low bits of next() are weak, so every
+ * draw uses the high ones. The integer sequence is the same on every
+ * platform, but gaussian() goes through std::log and std::cos, whose
+ * results depend on the math library.
+ */
+class Rng {
+public:
+    explicit Rng(std::uint64_t seed) {
+        for (auto& word : state_) {
+            seed += 0x9e3779b97f4a7c15ull;
+            std::uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            word = static_cast<std::uint32_t>(z ^ (z >> 31));
+        }
+    }
+
+    std::uint32_t next() {
+        const std::uint32_t result = state_[0] + state_[3];
+        const std::uint32_t t = state_[1] << 9;
+        state_[2] ^= state_[0];
+        state_[3] ^= state_[1];
+        state_[1] ^= state_[2];
+        state_[0] ^= state_[3];
+        state_[2] ^= t;
+        state_[3] = (state_[3] << 11) | (state_[3] >> 21);
+        return result;
+    }
+
+    // Uniform in [0, 1), using the 24 high bits
+    float uniform() { return static_cast<float>(next() >> 8) * 0x1.0p-24f; }
+    float uniform(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+
+    // Standard normal sample (Box-Muller, one of the pair is dropped)
+    float gaussian() {
+        const float u = 1.f - uniform();  // (0, 1]
+        const float v = uniform();
+        return std::sqrt(-2.f * std::log(u)) * std::cos(6.28318531f * v);
+    }
+
+private:
+    std::array<std::uint32_t, 4> state_;
+};
+
+enum class Workload { Uniform, Clusters, Ball, Filaments, OneCell };
+
+inline constexpr std::array workloads = {Workload::Uniform, Workload::Clusters, Workload::Ball,
+                                         Workload::Filaments, Workload::OneCell};
+
+constexpr std::string_view name(Workload workload) {
+    switch (workload) {
+        case Workload::Uniform: return "uniform";
+        case Workload::Clusters: return "clusters";
+        case Workload::Ball: return "ball";
+        case Workload::Filaments: return "filaments";
+        case Workload::OneCell: return "one-cell";
+    }
+    return "?";
+}
+
+/**
+ * Initial positions for benchmark scenes in a width x height world:
+ *
+ * - Uniform: the flattering case for every index.
+ * - Clusters: 16 Gaussian blobs, close to what flocks converge to.
+ * - Ball: a single dense disk covering 1% of the world.
+ * - Filaments: 8 thin segments with a 2 px Gaussian thickness.
+ * - OneCell: everything inside one square of side `cell`, the adversarial
+ *   case for a uniform grid of that cell size.
+ *
+ * The same seed always gives the same scene with the same math library:
+ * the Gaussian scenes and Ball go through std::log, std::cos and std::sin.
+ */
+inline std::vector<point_2d> generate(Workload workload, std::size_t n, float width, float height,
+                                      std::uint64_t seed, float cell = 50.f) {
+    Rng rng(seed);
+    std::vector<point_2d> points;
+    points.reserve(n);
+    const float extent = std::min(width, height);
+    auto keep = [&](float x, float y) {
+        x -= width * std::floor(x / width);
+        y -= height * std::floor(y / height);
+        points.push_back({x, y});
+    };
+
+    switch (workload) {
+        case Workload::Uniform:
+            while (points.size() < n) keep(rng.uniform(0.f, width), rng.uniform(0.f, height));
+            break;
+        case Workload::Clusters: {
+            std::array<point_2d, 16> centers;
+            for (auto& c : centers) c = {rng.uniform(0.f, width), rng.uniform(0.f, height)};
+            const float sigma = 0.03f * extent;
+            for (std::size_t i = 0; i < n; ++i) {
+                auto const& c = centers[rng.next() >> 28];  // The 4 high bits pick one of 16
+                keep(c.x + sigma * rng.gaussian(), c.y + sigma * rng.gaussian());
+            }
+            break;
+        }
+        case Workload::Ball: {
+            const float radius = 0.0564f * extent;  // pi r^2 = 1% of the area
+            for (std::size_t i = 0; i < n; ++i) {
+                const float r = radius * std::sqrt(rng.uniform());
+                const float a = 6.28318531f * rng.uniform();
+                keep(0.5f * width + r * std::cos(a), 0.5f * height + r * std::sin(a));
+            }
+            break;
+        }
+        case Workload::Filaments: {
+            std::array<std::array<point_2d, 2>, 8> segments;
+            for (auto& s : segments)
+                for (auto& p : s) p = {rng.uniform(0.f, width), rng.uniform(0.f, height)};
+            for (std::size_t i = 0; i < n; ++i) {
+                auto const& [a, b] = segments[rng.next() >> 29];  // The 3 high bits pick one of 8
+                const Vec2 along = b - a;
+                const float length = std::max(along.length(), 1e-3f);
+                const Vec2 normal{-along.y / length, along.x / length};
+                const Vec2 p = a + along * rng.uniform() + normal * (2.f * rng.gaussian());
+                keep(p.x, p.y);
+            }
+            break;
+        }
+        case Workload::OneCell: {
+            const float x0 = std::floor(0.5f * width / cell) * cell;
+            const float y0 = std::floor(0.5f * height / cell) * cell;
+            for (std::size_t i = 0; i < n; ++i)
+                keep(x0 + rng.uniform(0.f, cell), y0 + rng.uniform(0.f, cell));
+            break;
+        }
+    }
+    return points;
+}